@@ -2,6 +2,7 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include "basisCurves.h"
+#include "compactAttributes.h"
 #include "config.h"
 #include "context.h"
 #include "instancer.h"
@@ -18,6 +19,9 @@
 
 #include <rkcommon/math/AffineSpace.h>
 
+#include <algorithm>
+#include <cstdint>
+
 using namespace rkcommon::math;
 
 // clang-format off
@@ -48,7 +52,7 @@ HdOSPRayBasisCurves::GetInitialDirtyBitsMask() const
            | HdChangeTracker::DirtyTopology | HdChangeTracker::DirtyTransform
            | HdChangeTracker::DirtyVisibility | HdChangeTracker::DirtyWidths
            | HdChangeTracker::DirtyComputationPrimvarDesc
-           | HdChangeTracker::DirtyInstancer;
+           | HdChangeTracker::DirtyInstancer | HdChangeTracker::DirtyRenderTag;
 
     return (HdDirtyBits)mask;
 }
@@ -77,6 +81,43 @@ HdOSPRayBasisCurves::Sync(HdSceneDelegate* delegate, HdRenderParam* renderParam,
     SdfPath const& id = GetId();
     bool updateGeometry = false;
     bool isTransformDirty = false;
+    // animated points and widths are updated on the existing geometry
+    const bool updatePositionsOnly = _ospCurves
+           && (*dirtyBits
+               & (HdChangeTracker::DirtyPoints | HdChangeTracker::DirtyWidths))
+           && !(*dirtyBits
+                & (HdChangeTracker::DirtyTopology
+                   | HdChangeTracker::DirtyNormals
+                   | HdChangeTracker::DirtyPrimvar));
+
+    if (*dirtyBits & HdChangeTracker::DirtyVisibility) {
+        _UpdateVisibility(delegate, dirtyBits);
+        ospRenderParam->UpdateModelVersion();
+    }
+    // the render pass filters instances by render tag
+    if (*dirtyBits & HdChangeTracker::DirtyRenderTag) {
+        _syncedRenderTag = delegate->GetRenderTag(id);
+        *dirtyBits &= ~HdChangeTracker::DirtyRenderTag;
+        ospRenderParam->UpdateModelVersion();
+    }
+    // hidden curves keep their dirty bits and are built once they become
+    // visible
+    if (!IsVisible()) {
+        *dirtyBits &= ~HdChangeTracker::DirtyVisibility;
+        return;
+    }
+
+    // points and widths released in lean memory mode are pulled again for
+    // any change that rebuilds the curves
+    if (_sourcesReleased
+        && (*dirtyBits
+            & (HdChangeTracker::DirtyTopology | HdChangeTracker::DirtyPoints
+               | HdChangeTracker::DirtyWidths | HdChangeTracker::DirtyPrimvar
+               | HdChangeTracker::DirtyNormals))) {
+        *dirtyBits |= HdChangeTracker::DirtyPoints
+               | HdChangeTracker::DirtyWidths;
+        _sourcesReleased = false;
+    }
     if (*dirtyBits & HdChangeTracker::DirtyTopology) {
         _topology = delegate->GetBasisCurvesTopology(id);
         if (_topology.HasIndices()) {
@@ -92,8 +133,6 @@ HdOSPRayBasisCurves::Sync(HdSceneDelegate* delegate, HdRenderParam* renderParam,
         _xfm = GfMatrix4f(delegate->GetTransform(id));
         isTransformDirty = true;
     }
-    if (*dirtyBits & HdChangeTracker::DirtyVisibility) {
-    }
     if (HdChangeTracker::IsPrimvarDirty(*dirtyBits, id, HdTokens->normals)
         || HdChangeTracker::IsPrimvarDirty(*dirtyBits, id, HdTokens->widths)
         || HdChangeTracker::IsPrimvarDirty(*dirtyBits, id, HdTokens->points)
@@ -108,8 +147,12 @@ HdOSPRayBasisCurves::Sync(HdSceneDelegate* delegate, HdRenderParam* renderParam,
         updateGeometry = true;
     }
 
+    bool newModel = false;
     if (updateGeometry) {
-        _UpdateOSPRayRepr(delegate, reprToken, dirtyBits, ospRenderParam);
+        if (!updatePositionsOnly || !_UpdatePositions(ospRenderParam)) {
+            _UpdateOSPRayRepr(delegate, reprToken, dirtyBits, ospRenderParam);
+            newModel = true;
+        }
     }
 
 #if HD_API_VERSION < 36
@@ -120,54 +163,96 @@ HdOSPRayBasisCurves::Sync(HdSceneDelegate* delegate, HdRenderParam* renderParam,
                                           GetInstancerId());
 #endif
 
-    if ((HdChangeTracker::IsInstancerDirty(*dirtyBits, id) || isTransformDirty)
-        && !_geometricModels.empty()) {
-        _ospInstances.clear();
+    // a new geometric model has to be added to new instances
+    if ((HdChangeTracker::IsInstancerDirty(*dirtyBits, id) || isTransformDirty
+         || newModel)
+        && _geometricModel) {
+        if (newModel || !_group) {
+            _group = opp::Group();
+            _group.setParam("geometry", opp::CopiedData(_geometricModel));
+            _group.commit();
+            _ospInstances.clear();
+            _instanceTransforms.clear();
+            _instanceMask.clear();
+        }
+        // instances of an unchanged model are updated where their transform
+        // changed, toggled visibility only changes which are collected
+        std::vector<affine3f> previousTransforms;
+        previousTransforms.swap(_instanceTransforms);
+        std::vector<unsigned char> previousMask;
+        previousMask.swap(_instanceMask);
+        std::vector<vec4f> instanceColors;
+        std::vector<unsigned int> instanceIds;
         if (!GetInstancerId().IsEmpty()) {
             // Retrieve instance transforms from the instancer.
             HdRenderIndex& renderIndex = delegate->GetRenderIndex();
-            HdInstancer* instancer = renderIndex.GetInstancer(GetInstancerId());
-            VtMatrix4dArray transforms
-                   = static_cast<HdOSPRayInstancer*>(instancer)
-                            ->ComputeInstanceTransforms(GetId());
+            HdOSPRayInstancer* instancer = static_cast<HdOSPRayInstancer*>(
+                   renderIndex.GetInstancer(GetInstancerId()));
+            std::vector<affine3f> transforms
+                   = instancer->ComputeInstanceTransforms(GetId());
+            instanceColors = instancer->ComputeInstanceColors(GetId());
+            instanceIds = instancer->ComputeInstanceIds(GetId());
+            _instanceMask = instancer->ComputeInstanceMask(GetId());
+            if (instanceColors.size() != transforms.size())
+                instanceColors.clear();
+            if (instanceIds.size() != transforms.size())
+                instanceIds.clear();
+            if (_instanceMask.size() != transforms.size())
+                _instanceMask.clear();
 
             size_t newSize = transforms.size();
-
-            opp::Group group;
-            group.setParam("geometry", opp::CopiedData(_geometricModels));
-            group.commit();
-
-            _ospInstances.reserve(newSize);
-            for (size_t i = 0; i < newSize; i++) {
-                opp::Instance instance(group);
-
-                GfMatrix4f matf = _xfm * GfMatrix4f(transforms[i]);
-                float* xfmf = matf.GetArray();
-                affine3f xfm(vec3f(xfmf[0], xfmf[1], xfmf[2]),
-                             vec3f(xfmf[4], xfmf[5], xfmf[6]),
-                             vec3f(xfmf[8], xfmf[9], xfmf[10]),
-                             vec3f(xfmf[12], xfmf[13], xfmf[14]));
-                instance.setParam("xfm", xfm);
-                instance.commit();
-                _ospInstances.push_back(instance);
-            }
+            float* xfmf = _xfm.GetArray();
+            const affine3f prototypeXfm(vec3f(xfmf[0], xfmf[1], xfmf[2]),
+                                        vec3f(xfmf[4], xfmf[5], xfmf[6]),
+                                        vec3f(xfmf[8], xfmf[9], xfmf[10]),
+                                        vec3f(xfmf[12], xfmf[13], xfmf[14]));
+
+            _instanceTransforms.resize(newSize);
+            for (size_t i = 0; i < newSize; i++)
+                _instanceTransforms[i] = transforms[i] * prototypeXfm;
         } else {
-            opp::Group group;
-            group.setParam("geometry", opp::CopiedData(_geometricModels));
-            group.commit();
-            opp::Instance instance(group);
             GfMatrix4f matf = _xfm;
             float* xfmf = matf.GetArray();
             affine3f xfm(vec3f(xfmf[0], xfmf[1], xfmf[2]),
                          vec3f(xfmf[4], xfmf[5], xfmf[6]),
                          vec3f(xfmf[8], xfmf[9], xfmf[10]),
                          vec3f(xfmf[12], xfmf[13], xfmf[14]));
-            instance.setParam("transform", xfm);
-            instance.commit();
-            _ospInstances.push_back(instance);
+            _instanceTransforms.assign(1, xfm);
+        }
+        // instance primvars rebuild all instances
+        const bool instancePrimvars
+               = !instanceColors.empty() || !instanceIds.empty();
+        bool instancesAdded = true;
+        if (instancePrimvars || _instancePrimvars)
+            _ospInstances.clear();
+        if (!instanceColors.empty()) {
+            // colored instances share the geometry, not the model
+            auto createModel = [this]() {
+                opp::GeometricModel model(_ospCurves);
+                model.setParam("material", _ospMaterial);
+                return model;
+            };
+            HdOSPRayCreateColoredInstances(createModel, _instanceTransforms,
+                                           instanceColors, instanceIds,
+                                           _ospInstances, _instanceMask);
+        } else if (!instanceIds.empty()) {
+            HdOSPRayCreateInstances(_group, _instanceTransforms, _ospInstances,
+                                    instanceIds, _instanceMask);
+        } else {
+            if (_instancePrimvars)
+                previousTransforms.clear();
+            instancesAdded = HdOSPRayUpdateInstances(
+                   _group, previousTransforms, _instanceTransforms,
+                   _ospInstances, previousMask, _instanceMask);
         }
+        _instancePrimvars = instancePrimvars;
+        _coloredInstances = !instanceColors.empty();
+        _instancesVersion++;
 
-        ospRenderParam->UpdateModelVersion();
+        if (instancesAdded)
+            ospRenderParam->UpdateModelVersion();
+        else
+            ospRenderParam->UpdateInstanceVersion();
     }
 
     *dirtyBits &= ~HdChangeTracker::AllSceneDirtyBits;
@@ -180,6 +265,11 @@ HdOSPRayBasisCurves::_UpdatePrimvarSources(HdSceneDelegate* sceneDelegate,
     HD_TRACE_FUNCTION();
     SdfPath const& id = GetId();
 
+    // partial updates, e.g. of opacities, need the float values
+    if (dirtyBits
+        & (HdChangeTracker::DirtyPrimvar | HdChangeTracker::DirtyNormals))
+        _RestoreCompactAttributes();
+
     HdPrimvarDescriptorVector primvars;
     for (size_t i = 0; i < HdInterpolationCount; ++i) {
         HdInterpolation interp = static_cast<HdInterpolation>(i);
@@ -194,7 +284,7 @@ HdOSPRayBasisCurves::_UpdatePrimvarSources(HdSceneDelegate* sceneDelegate,
                 continue;
             }
             if (pv.name == HdTokens->normals) {
-                if ((dirtyBits & HdChangeTracker::DirtyPoints)
+                if ((dirtyBits & HdChangeTracker::DirtyNormals)
                     && value.IsHolding<VtVec3fArray>()) {
                     _normals = value.Get<VtVec3fArray>();
                 }
@@ -259,106 +349,233 @@ HdOSPRayBasisCurves::_UpdatePrimvarSources(HdSceneDelegate* sceneDelegate,
     }
 }
 
+// curves with fewer strands are always rendered in full
+static constexpr size_t _minSubsetStrands = 1024;
+
+// Hash of a strand index to [0, 1).  Strands below the fraction are kept,
+// so the subset is the same every frame and grows with the fraction.
+static float
+_StrandHash(uint32_t strand)
+{
+    // murmur3 finalizer
+    strand ^= strand >> 16;
+    strand *= 0x85ebca6bu;
+    strand ^= strand >> 13;
+    strand *= 0xc2b2ae35u;
+    strand ^= strand >> 16;
+    return (strand >> 8) * (1.f / 16777216.f);
+}
+
+// Hand an attribute array to OSPRay.  Copied arrays are owned by OSPRay, so
+// the host array can be released after the commit.
+template <class T>
+static void
+_SetAttributeParam(opp::Geometry& geometry, const char* param,
+                   VtArray<T> const& values, OSPDataType type, bool copy)
+{
+    if (copy) {
+        geometry.setParam(param,
+                          opp::CopiedData(values.cdata(), type, values.size()));
+    } else {
+        opp::SharedData data(values.cdata(), type, values.size());
+        data.commit();
+        geometry.setParam(param, data);
+    }
+}
+
+// One value per curve vertex.  Vertex values of indexed curves are gathered
+// through the indices, uniform values are repeated for all vertices of their
+// curve.  Returns an empty array for other sizes.
+template <class T>
+static VtArray<T>
+_ExpandCurveAttribute(VtArray<T> const& values, VtIntArray const& vertexCounts,
+                      VtIntArray const& indices, size_t numPoints,
+                      size_t numCurveVertices)
+{
+    if (values.size() == numPoints) {
+        if (indices.empty())
+            return values;
+        VtArray<T> result(indices.size());
+        T* dst = result.data();
+        for (size_t i = 0; i < indices.size(); i++)
+            dst[i] = values[indices[i]];
+        return result;
+    }
+    if (values.size() == vertexCounts.size()) {
+        VtArray<T> result(numCurveVertices);
+        T* dst = result.data();
+        size_t offset = 0;
+        for (size_t c = 0; c < vertexCounts.size(); c++) {
+            std::fill(dst + offset, dst + offset + vertexCounts[c], values[c]);
+            offset += vertexCounts[c];
+        }
+        return result;
+    }
+    return VtArray<T>();
+}
+
+void
+HdOSPRayBasisCurves::_CompactAttributes()
+{
+    size_t floatBytes = 0;
+    size_t compactBytes = 0;
+    if (_normals.size() > 1) {
+        _compactNormals = HdOSPRayCompactArray::EncodeNormals(_normals);
+        floatBytes += _compactNormals.GetDecodedByteSize();
+        compactBytes += _compactNormals.GetByteSize();
+        _normals = VtVec3fArray();
+    }
+    if (_colors.size() > 1) {
+        _compactColors = HdOSPRayCompactArray::EncodeColors(_colors);
+        floatBytes += _compactColors.GetDecodedByteSize();
+        compactBytes += _compactColors.GetByteSize();
+        _colors = VtVec4fArray();
+    }
+    if (_texcoords.size() > 1) {
+        _compactTexcoords = HdOSPRayCompactArray::EncodeTexcoords(_texcoords);
+        floatBytes += _compactTexcoords.GetDecodedByteSize();
+        compactBytes += _compactTexcoords.GetByteSize();
+        _texcoords = VtVec2fArray();
+    }
+    TF_DEBUG_MSG(OSP,
+                 "osp::curves %s: compact attributes %zu bytes, saved %zu "
+                 "bytes\n",
+                 GetId().GetText(), compactBytes, floatBytes - compactBytes);
+}
+
+void
+HdOSPRayBasisCurves::_RestoreCompactAttributes()
+{
+    if (_normals.empty() && !_compactNormals.IsEmpty())
+        _compactNormals.Decode(&_normals);
+    if (_colors.empty() && !_compactColors.IsEmpty())
+        _compactColors.Decode(&_colors);
+    if (_texcoords.empty() && !_compactTexcoords.IsEmpty())
+        _compactTexcoords.Decode(&_texcoords);
+    _compactNormals.Clear();
+    _compactColors.Clear();
+    _compactTexcoords.Clear();
+}
+
 void
 HdOSPRayBasisCurves::_UpdateOSPRayRepr(HdSceneDelegate* sceneDelegate,
                                        TfToken const& reprToken,
                                        HdDirtyBits* dirtyBitsState,
                                        HdOSPRayRenderParam* renderParam)
 {
-    bool hasWidths = (_widths.size() == _points.size());
+    _RestoreCompactAttributes();
+
     bool hasNormals = (_normals.size() == _points.size());
     if (_points.empty()) {
         TF_RUNTIME_ERROR("_UpdateOSPRayRepr: points empty");
         return;
     }
 
-    _ospCurves = opp::Geometry("curve");
-    _position_radii.clear();
-
-    for (size_t i = 0; i < _points.size(); i++) {
-        const float width = hasWidths ? _widths[i] / 2.f : 1.0f;
-        _position_radii.emplace_back(
-               vec4f({ _points[i][0], _points[i][1], _points[i][2], width }));
+    // all curves of the prim form one geometry.  Indexed curves are
+    // expanded, OSPRay segments start at consecutive vertices.
+    const VtIntArray& vertexCounts = _topology.GetCurveVertexCounts();
+    const size_t numPoints = _points.size();
+    const size_t numCurveVertices
+           = _indices.empty() ? numPoints : _indices.size();
+    size_t numCountedVertices = 0;
+    for (int count : vertexCounts)
+        numCountedVertices += std::max(0, count);
+    if (numCountedVertices != numCurveVertices) {
+        TF_RUNTIME_ERROR("hdosp::basisCurves %s: vertex counts do not match "
+                         "the number of vertices",
+                         GetId().GetText());
+        return;
     }
-
-    opp::SharedData vertices = opp::SharedData(
-           _position_radii.data(), OSP_VEC4F, _position_radii.size());
-    vertices.commit();
-    _ospCurves.setParam("vertex.position_radius", vertices);
-
-    opp::SharedData normals;
-    if (hasNormals) {
-        normals = opp::SharedData(_normals.data(), OSP_VEC3F, _normals.size());
-        normals.commit();
-        _ospCurves.setParam("vertex.normal", normals);
+    for (int index : _indices) {
+        if (index < 0 || size_t(index) >= numPoints) {
+            TF_RUNTIME_ERROR("hdosp::basisCurves %s: curve index out of range",
+                             GetId().GetText());
+            return;
+        }
     }
 
+    _numPoints = numPoints;
+    _radiusMode = _ResolveRadiusMode(&_radius);
+
     auto type = _topology.GetCurveType();
-    if (type != HdTokens->cubic) // TODO: linear
+    const bool linear = (type == HdTokens->linear);
+    if (!linear && type != HdTokens->cubic)
         TF_RUNTIME_ERROR("hdosp::basisCurves - Curve type not supported");
-    auto basis = _topology.GetCurveBasis();
-    const bool hasIndices = !_indices.empty();
-    auto vertexCounts = _topology.GetCurveVertexCounts();
-    size_t index = 0;
-    for (auto vci : vertexCounts) {
-        std::vector<unsigned int> indices;
-        for (size_t i = 0; i < vci - size_t(3); i++) {
-            if (hasIndices)
-                indices.push_back(_indices[index]);
-            else
-                indices.push_back(index);
-            index++;
-        }
-        index += 3;
-        auto geometry = opp::Geometry("curve");
-        geometry.setParam("vertex.position_radius", vertices);
-        if (_colors.size() > 1) {
-            opp::SharedData colors = opp::SharedData(_colors.cdata(), OSP_VEC4F,
-                                                     _colors.size());
-            colors.commit();
-            geometry.setParam("vertex.color", colors);
-        }
 
-        if (_texcoords.size() > 1) {
-            opp::SharedData texcoords = opp::SharedData(
-                   _texcoords.cdata(), OSP_VEC2F, _texcoords.size());
-            texcoords.commit();
-            geometry.setParam("vertex.texcoord", texcoords);
-        }
+    // a segment starts at every vertex but the last one of a linear curve or
+    // the last three of a cubic curve
+    const int segmentVertices = linear ? 2 : 4;
+    std::vector<unsigned int> segments;
+    segments.reserve(numCurveVertices);
+    size_t offset = 0;
+    for (int count : vertexCounts) {
+        for (int i = 0; i + segmentVertices <= count; i++)
+            segments.push_back(offset + i);
+        offset += std::max(0, count);
+    }
 
-        if (hasNormals)
-            geometry.setParam("vertex.normal", normals);
-
-        geometry.setParam("index", opp::CopiedData(indices));
-        geometry.setParam("type", OSP_ROUND);
-        if (hasNormals)
-            geometry.setParam("type", OSP_RIBBON);
-        if (basis == HdTokens->bSpline)
-            geometry.setParam("basis", OSP_BSPLINE);
-        else if (basis == HdTokens->catmullRom)
-            geometry.setParam("basis", OSP_CATMULL_ROM);
-        else
-            TF_RUNTIME_ERROR("hdospBS::sync: unsupported curve basis");
-        geometry.commit();
-        const HdRenderIndex& renderIndex = sceneDelegate->GetRenderIndex();
-        const HdOSPRayMaterial* material
-               = static_cast<const HdOSPRayMaterial*>(renderIndex.GetSprim(
-                      HdPrimTypeTokens->material, GetMaterialId()));
-        opp::Material ospMaterial;
-        if (material && material->GetOSPRayMaterial()) {
-            ospMaterial = material->GetOSPRayMaterial();
-        } else {
-            // no material, create a new one
-            ospMaterial = HdOSPRayMaterial::CreateDefaultMaterial(_singleColor);
+    _ospCurves = opp::Geometry("curve");
+    _SetVertexParams();
+    _ospCurves.setParam("index", opp::CopiedData(segments));
+    _SetCurveBasis(_ospCurves, hasNormals);
+
+    // With compact attributes on devices keeping their own copy of shared
+    // data, OSPRay gets copies and the host keeps reduced precision values
+    // only.  Expanded arrays are temporary and always copied.
+    const bool compactAttributes
+           = HdOSPRayConfig::GetInstance().compactAttributes
+           && !HdOSPRayDeviceSharesHostArrays();
+    if (hasNormals) {
+        VtVec3fArray normals = _ExpandCurveAttribute(
+               _normals, vertexCounts, _indices, numPoints, numCurveVertices);
+        _SetAttributeParam(
+               _ospCurves, "vertex.normal", normals, OSP_VEC3F,
+               compactAttributes || normals.cdata() != _normals.cdata());
+    }
+    if (_colors.size() > 1) {
+        VtVec4fArray colors = _ExpandCurveAttribute(
+               _colors, vertexCounts, _indices, numPoints, numCurveVertices);
+        if (!colors.empty()) {
+            _SetAttributeParam(
+                   _ospCurves, "vertex.color", colors, OSP_VEC4F,
+                   compactAttributes || colors.cdata() != _colors.cdata());
+        }
+    }
+    if (_texcoords.size() > 1) {
+        VtVec2fArray texcoords = _ExpandCurveAttribute(
+               _texcoords, vertexCounts, _indices, numPoints, numCurveVertices);
+        if (!texcoords.empty()) {
+            _SetAttributeParam(_ospCurves, "vertex.texcoord", texcoords,
+                               OSP_VEC2F,
+                               compactAttributes
+                                      || texcoords.cdata()
+                                             != _texcoords.cdata());
         }
+    }
+    _ospCurves.commit();
+
+    const HdRenderIndex& renderIndex = sceneDelegate->GetRenderIndex();
+    const HdOSPRayMaterial* material = static_cast<const HdOSPRayMaterial*>(
+           renderIndex.GetSprim(HdPrimTypeTokens->material, GetMaterialId()));
+    opp::Material ospMaterial;
+    if (material && material->GetOSPRayMaterial()) {
+        ospMaterial = material->GetOSPRayMaterial();
+    } else {
+        // no material, create a new one
+        ospMaterial = HdOSPRayMaterial::CreateDefaultMaterial(_singleColor);
+    }
 
-        // Create OSPRay model
-        auto gm = opp::GeometricModel(geometry);
+    // Create OSPRay model
+    _geometricModel = opp::GeometricModel(_ospCurves);
+    _geometricModel.setParam("material", ospMaterial);
+    _geometricModel.commit();
+    _ospMaterial = ospMaterial;
+    _geometryVersion++;
 
-        gm.setParam("material", ospMaterial);
-        gm.commit();
-        _geometricModels.push_back(gm);
-    }
+    if (compactAttributes)
+        _CompactAttributes();
+
+    _ReleaseSources();
 
     renderParam->UpdateModelVersion();
 
@@ -369,11 +586,264 @@ HdOSPRayBasisCurves::_UpdateOSPRayRepr(HdSceneDelegate* sceneDelegate,
 }
 
 void
-HdOSPRayBasisCurves::AddOSPInstances(
-       std::vector<opp::Instance>& instanceList) const
+HdOSPRayBasisCurves::_SetCurveBasis(opp::Geometry& curves, bool ribbons) const
+{
+    curves.setParam("type", OSP_ROUND);
+    if (_topology.GetCurveType() == HdTokens->linear) {
+        // ribbons need a cubic basis, linear curves are always round
+        curves.setParam("basis", OSP_LINEAR);
+        return;
+    }
+    if (ribbons)
+        curves.setParam("type", OSP_RIBBON);
+    auto basis = _topology.GetCurveBasis();
+    if (basis == HdTokens->bSpline)
+        curves.setParam("basis", OSP_BSPLINE);
+    else if (basis == HdTokens->catmullRom)
+        curves.setParam("basis", OSP_CATMULL_ROM);
+    else
+        TF_RUNTIME_ERROR("hdospBS::sync: unsupported curve basis");
+}
+
+HdOSPRayBasisCurves::_RadiusMode
+HdOSPRayBasisCurves::_ResolveRadiusMode(float* constantRadius) const
+{
+    // the global radius is only supported by round linear curves, linear
+    // curves are never ribbons
+    const _RadiusMode constant = _topology.GetCurveType() == HdTokens->linear
+           ? _RadiusMode::Constant
+           : _RadiusMode::ConstantVertex;
+    *constantRadius = 1.f;
+    if (_widths.empty())
+        return constant;
+    // equal widths, e.g. constant or uniform over all curves, need no
+    // per-vertex radii
+    if (std::all_of(_widths.begin(), _widths.end(),
+                    [this](float w) { return w == _widths[0]; })) {
+        *constantRadius = _widths[0] / 2.f;
+        return constant;
+    }
+    if (_widths.size() == _points.size())
+        return _RadiusMode::Vertex;
+    if (_widths.size() == _topology.GetCurveVertexCounts().size())
+        return _RadiusMode::Uniform;
+    TF_DEBUG_MSG(OSP, "hdosp::basisCurves %s: unsupported number of widths\n",
+                 GetId().GetText());
+    return constant;
+}
+
+void
+HdOSPRayBasisCurves::_FillVertices()
+{
+    const size_t numCurveVertices
+           = _indices.empty() ? _points.size() : _indices.size();
+    if (_radiusMode == _RadiusMode::Constant) {
+        _position_radii = std::vector<vec4f>();
+        _positions.resize(numCurveVertices);
+        for (size_t i = 0; i < numCurveVertices; i++) {
+            const size_t point = _indices.empty() ? i : size_t(_indices[i]);
+            const GfVec3f& p = _points[point];
+            _positions[i] = vec3f(p[0], p[1], p[2]);
+        }
+        return;
+    }
+
+    _positions = std::vector<vec3f>();
+    _position_radii.resize(numCurveVertices);
+    if (_radiusMode == _RadiusMode::ConstantVertex) {
+        for (size_t i = 0; i < numCurveVertices; i++) {
+            const size_t point = _indices.empty() ? i : size_t(_indices[i]);
+            const GfVec3f& p = _points[point];
+            _position_radii[i] = vec4f(p[0], p[1], p[2], _radius);
+        }
+        return;
+    }
+    if (_radiusMode == _RadiusMode::Vertex) {
+        for (size_t i = 0; i < numCurveVertices; i++) {
+            const size_t point = _indices.empty() ? i : size_t(_indices[i]);
+            const GfVec3f& p = _points[point];
+            _position_radii[i] = vec4f(p[0], p[1], p[2], _widths[point] / 2.f);
+        }
+        return;
+    }
+
+    // one width per curve
+    const VtIntArray& vertexCounts = _topology.GetCurveVertexCounts();
+    size_t i = 0;
+    for (size_t curve = 0; curve < vertexCounts.size(); curve++) {
+        const float radius = _widths[curve] / 2.f;
+        for (int v = 0; v < vertexCounts[curve]; v++, i++) {
+            const size_t point = _indices.empty() ? i : size_t(_indices[i]);
+            const GfVec3f& p = _points[point];
+            _position_radii[i] = vec4f(p[0], p[1], p[2], radius);
+        }
+    }
+}
+
+void
+HdOSPRayBasisCurves::_SetVertexParams()
+{
+    _FillVertices();
+    if (_radiusMode == _RadiusMode::Constant) {
+        opp::SharedData vertices
+               = opp::SharedData(_positions.data(), OSP_VEC3F,
+                                 _positions.size());
+        vertices.commit();
+        _ospCurves.setParam("vertex.position", vertices);
+        _ospCurves.setParam("radius", _radius);
+    } else {
+        opp::SharedData vertices = opp::SharedData(
+               _position_radii.data(), OSP_VEC4F, _position_radii.size());
+        vertices.commit();
+        _ospCurves.setParam("vertex.position_radius", vertices);
+    }
+}
+
+bool
+HdOSPRayBasisCurves::_UpdatePositions(HdOSPRayRenderParam* renderParam)
+{
+    // the indices were validated against the point count of the last rebuild
+    float radius = 1.f;
+    // the groups of color buckets are not kept, they are rebuilt with their
+    // instances
+    if (_points.empty() || _points.size() != _numPoints || _coloredInstances
+        || _ResolveRadiusMode(&radius) != _radiusMode)
+        return false;
+
+    _radius = radius;
+    _SetVertexParams();
+    _ospCurves.commit();
+    // instances keep referencing the group, only its BVH is rebuilt
+    if (_group)
+        _group.commit();
+    _geometryVersion++;
+
+    _ReleaseSources();
+    // the world instance list is unchanged, the world is only recommitted
+    renderParam->UpdateInstanceVersion();
+    return true;
+}
+
+void
+HdOSPRayBasisCurves::_ReleaseSources()
+{
+    // positions and radii are interleaved into _position_radii, the authored
+    // arrays are only needed for the next update
+    if (HdOSPRayConfig::GetInstance().leanMemory) {
+        _points = VtVec3fArray();
+        _widths = VtFloatArray();
+        _sourcesReleased = true;
+    }
+}
+
+void
+HdOSPRayBasisCurves::Finalize(HdRenderParam* renderParam)
+{
+    if (_populated) {
+        static_cast<HdOSPRayRenderParam*>(renderParam)
+               ->RemoveHdOSPRayBasisCurves(this);
+        _populated = false;
+    }
+    _ospInstances.clear();
+    _group = nullptr;
+    _geometricModel = nullptr;
+    _ospCurves = nullptr;
+    _ospMaterial = nullptr;
+    _positions = std::vector<vec3f>();
+    _position_radii = std::vector<vec4f>();
+    _subset = _StrandSubset();
+}
+
+bool
+HdOSPRayBasisCurves::AddOSPInstances(std::vector<opp::Instance>& instanceList,
+                                     float strandFraction) const
+{
+    if (!IsVisible())
+        return false;
+    if (strandFraction < 1.f && _UpdateStrandSubset(strandFraction)) {
+        HdOSPRayAppendVisibleInstances(_subset.instances, _instanceMask,
+                                       instanceList);
+        return true;
+    }
+    HdOSPRayAppendVisibleInstances(_ospInstances, _instanceMask,
+                                   instanceList);
+    return false;
+}
+
+bool
+HdOSPRayBasisCurves::_UpdateStrandSubset(float strandFraction) const
 {
-    if (IsVisible()) {
-        instanceList.insert(instanceList.end(), _ospInstances.begin(),
-                            _ospInstances.end());
+    const VtIntArray& vertexCounts = _topology.GetCurveVertexCounts();
+    if (!_geometricModel || vertexCounts.size() < _minSubsetStrands)
+        return false;
+
+    if (_subset.fraction != strandFraction
+        || _subset.geometryVersion != _geometryVersion) {
+        _subset.fraction = strandFraction;
+        _subset.geometryVersion = _geometryVersion;
+        _subset.instancesVersion = -1;
+        _subset.group = nullptr;
+        _subset.instances.clear();
+
+        // kept strands are widened by the inverse fraction, which keeps the
+        // projected area of all strands
+        const float widen = 1.f / strandFraction;
+        const bool linear = (_topology.GetCurveType() == HdTokens->linear);
+        const int segmentVertices = linear ? 2 : 4;
+        std::vector<vec4f>& vertices = _subset.vertices;
+        vertices.clear();
+        std::vector<unsigned int> segments;
+        size_t keptStrands = 0;
+        size_t offset = 0;
+        for (size_t curve = 0; curve < vertexCounts.size(); curve++) {
+            const int count = std::max(0, vertexCounts[curve]);
+            if (_StrandHash(uint32_t(curve)) < strandFraction) {
+                keptStrands++;
+                const size_t first = vertices.size();
+                for (int i = 0; i < count; i++) {
+                    vec4f vertex = _radiusMode == _RadiusMode::Constant
+                           ? vec4f(_positions[offset + i], _radius)
+                           : _position_radii[offset + i];
+                    vertex.w *= widen;
+                    vertices.push_back(vertex);
+                }
+                for (int i = 0; i + segmentVertices <= count; i++)
+                    segments.push_back(first + i);
+            }
+            offset += count;
+        }
+        if (segments.empty() || keptStrands == vertexCounts.size()) {
+            vertices = std::vector<vec4f>();
+            return false;
+        }
+
+        // per-vertex attributes are left out, the subset is only shown
+        // while interacting
+        opp::Geometry curves("curve");
+        opp::SharedData vertexData = opp::SharedData(
+               vertices.data(), OSP_VEC4F, vertices.size());
+        vertexData.commit();
+        curves.setParam("vertex.position_radius", vertexData);
+        curves.setParam("index", opp::CopiedData(segments));
+        _SetCurveBasis(curves, false);
+        curves.commit();
+        opp::GeometricModel model(curves);
+        model.setParam("material", _ospMaterial);
+        model.commit();
+        _subset.group = opp::Group();
+        _subset.group.setParam("geometry", opp::CopiedData(model));
+        _subset.group.commit();
+        TF_DEBUG_MSG(OSP, "hdosp::basisCurves %s: %zu of %zu strands kept\n",
+                     GetId().GetText(), keptStrands, vertexCounts.size());
+    }
+    if (!_subset.group)
+        return false;
+
+    if (_subset.instancesVersion != _instancesVersion) {
+        _subset.instances.clear();
+        HdOSPRayCreateInstances(_subset.group, _instanceTransforms,
+                                _subset.instances, {}, _instanceMask);
+        _subset.instancesVersion = _instancesVersion;
     }
+    return true;
 }
\ No newline at end of file
@@ -8,9 +8,12 @@
 #include <pxr/base/vt/array.h>
 #include <pxr/imaging/hd/basisCurves.h>
 #include <pxr/imaging/hd/enums.h>
+#include <pxr/imaging/hd/tokens.h>
 #include <pxr/pxr.h>
 #include <pxr/usd/sdf/path.h>
 
+#include "compactAttributes.h"
+
 #include <ospray/ospray_cpp.h>
 #include <ospray/ospray_cpp/ext/rkcommon.h>
 
@@ -37,12 +40,23 @@ public:
 
     virtual HdDirtyBits GetInitialDirtyBitsMask() const override;
 
-    virtual void Finalize(HdRenderParam* renderParam) override
+    /// Removes the curves from the render param and releases the OSPRay
+    /// objects
+    virtual void Finalize(HdRenderParam* renderParam) override;
+
+    /// Add generated instances from sync function to the instanceList for
+    /// rendering.  With a strandFraction below 1, dense curves add instances
+    /// of a stable subset of widened strands instead.  Returns true if
+    /// subset instances were added.
+    bool AddOSPInstances(std::vector<opp::Instance>& instanceList,
+                         float strandFraction = 1.f) const;
+
+    /// Render tag pulled from the scene delegate in the last sync
+    TfToken const& GetSyncedRenderTag() const
     {
+        return _syncedRenderTag;
     }
 
-    void AddOSPInstances(std::vector<opp::Instance>& instanceList) const;
-
 protected:
     virtual void _InitRepr(TfToken const& reprToken,
                            HdDirtyBits* dirtyBits) override;
@@ -57,11 +71,67 @@ protected:
                            HdDirtyBits* dirtyBitsState,
                            HdOSPRayRenderParam* renderParam);
 
+    // widths map to a global radius if they are all equal and to per-vertex
+    // radii otherwise.  OSPRay only takes a global radius for linear curves,
+    // equal widths of cubic curves are repeated in every vertex.
+    enum class _RadiusMode { Constant, ConstantVertex, Vertex, Uniform };
+
+    _RadiusMode _ResolveRadiusMode(float* constantRadius) const;
+    /// Gather the positions, and radii unless constant, of all curve
+    /// vertices
+    void _FillVertices();
+    /// Fill the vertices and hand them to _ospCurves
+    void _SetVertexParams();
+    /// Update positions and radii on the existing geometry.  Returns false
+    /// if the vertex layout changed and the curves have to be rebuilt.
+    bool _UpdatePositions(HdOSPRayRenderParam* renderParam);
+    /// Set curve type and basis of curves from the topology
+    void _SetCurveBasis(opp::Geometry& curves, bool ribbons) const;
+    /// Rebuild the strand subset if the fraction or the geometry changed
+    /// and its instances if the instances changed.  Returns false if the
+    /// curves have no subset.
+    bool _UpdateStrandSubset(float strandFraction) const;
+    /// Lean memory mode: drop points and widths after they were interleaved
+    void _ReleaseSources();
+
+    /// Replace the attribute arrays by compact copies after they have been
+    /// copied to OSPRay
+    void _CompactAttributes();
+    /// Decode compact attribute copies before an update
+    void _RestoreCompactAttributes();
+
 private:
+    // all curves of the prim
     opp::Geometry _ospCurves;
-    std::vector<opp::GeometricModel> _geometricModels;
+    opp::GeometricModel _geometricModel { nullptr };
+    // referenced by all instances, recommitted for position updates
+    opp::Group _group { nullptr };
     std::vector<opp::Instance> _ospInstances;
-
+    std::vector<rkcommon::math::affine3f> _instanceTransforms;
+    // instancer visibility of _instanceTransforms, empty if all are visible
+    std::vector<unsigned char> _instanceMask;
+    // instances were created from instance-rate colors or ids
+    bool _instancePrimvars { false };
+    // instances reference a group per color bucket instead of _group
+    bool _coloredInstances { false };
+    opp::Material _ospMaterial { nullptr };
+    // bumped whenever vertices or instances change, to update _subset
+    int _geometryVersion { 0 };
+    int _instancesVersion { 0 };
+
+    // strands rendered while interacting, built on demand by AddOSPInstances
+    struct _StrandSubset {
+        float fraction { 1.f };
+        int geometryVersion { -1 };
+        int instancesVersion { -1 };
+        std::vector<rkcommon::math::vec4f> vertices;
+        opp::Group group { nullptr };
+        std::vector<opp::Instance> instances;
+    };
+    mutable _StrandSubset _subset;
+
+    // vertex data of _ospCurves, positions only with a constant radius
+    std::vector<rkcommon::math::vec3f> _positions;
     std::vector<rkcommon::math::vec4f> _position_radii;
     HdBasisCurvesTopology _topology;
     VtIntArray _indices;
@@ -72,5 +142,17 @@ private:
     VtVec2fArray _texcoords;
     VtVec4fArray _colors;
     GfVec4f _singleColor { .5f, .5f, .5f, 1.f };
+    // reduced precision copies of the attributes, see
+    // HdOSPRayConfig::compactAttributes
+    HdOSPRayCompactArray _compactNormals;
+    HdOSPRayCompactArray _compactColors;
+    HdOSPRayCompactArray _compactTexcoords;
+    // point count and radius layout of the last rebuild
+    size_t _numPoints { 0 };
+    _RadiusMode _radiusMode { _RadiusMode::Constant };
+    float _radius { 1.f };
     bool _populated { false };
+    // points and widths were dropped in lean memory mode
+    bool _sourcesReleased { false };
+    TfToken _syncedRenderTag { HdTokens->geometry };
 };
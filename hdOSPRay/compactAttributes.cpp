@@ -0,0 +1,215 @@
+// Copyright 2019 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include "compactAttributes.h"
+#include "config.h"
+
+#include <pxr/base/gf/half.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+uint16_t
+_EncodeSnorm16(float value)
+{
+    const float clamped = std::max(-1.f, std::min(1.f, value));
+    return uint16_t(int16_t(std::round(clamped * 32767.f)));
+}
+
+float
+_DecodeSnorm16(uint16_t value)
+{
+    return std::max(-1.f, float(int16_t(value)) / 32767.f);
+}
+
+float
+_SignNotZero(float value)
+{
+    return value >= 0.f ? 1.f : -1.f;
+}
+
+uint16_t
+_EncodeHalf(float value)
+{
+    return GfHalf(value).bits();
+}
+
+float
+_DecodeHalf(uint16_t bits)
+{
+    GfHalf half;
+    half.setBits(bits);
+    return float(half);
+}
+
+} // namespace
+
+HdOSPRayCompactArray
+HdOSPRayCompactArray::EncodeNormals(VtVec3fArray const& normals)
+{
+    HdOSPRayCompactArray result;
+    result._encoding = _Encoding::OctahedralNormal;
+    result._numElements = normals.size();
+    result._data.resize(normals.size() * 2);
+    for (size_t i = 0; i < normals.size(); i++) {
+        const GfVec3f& n = normals[i];
+        const float l1 = std::abs(n[0]) + std::abs(n[1]) + std::abs(n[2]);
+        // degenerate normals map to +z
+        float x = l1 > 0.f ? n[0] / l1 : 0.f;
+        float y = l1 > 0.f ? n[1] / l1 : 0.f;
+        if (l1 > 0.f && n[2] < 0.f) {
+            const float ox = x;
+            x = (1.f - std::abs(y)) * _SignNotZero(ox);
+            y = (1.f - std::abs(ox)) * _SignNotZero(y);
+        }
+        result._data[2 * i] = _EncodeSnorm16(x);
+        result._data[2 * i + 1] = _EncodeSnorm16(y);
+    }
+    return result;
+}
+
+HdOSPRayCompactArray
+HdOSPRayCompactArray::EncodeColors(VtVec3fArray const& colors)
+{
+    HdOSPRayCompactArray result;
+    result._encoding = _Encoding::Half3;
+    result._numElements = colors.size();
+    result._data.resize(colors.size() * 3);
+    for (size_t i = 0; i < colors.size(); i++) {
+        for (int c = 0; c < 3; c++)
+            result._data[3 * i + c] = _EncodeHalf(colors[i][c]);
+    }
+    return result;
+}
+
+HdOSPRayCompactArray
+HdOSPRayCompactArray::EncodeColors(VtVec4fArray const& colors)
+{
+    HdOSPRayCompactArray result;
+    result._encoding = _Encoding::Half4;
+    result._numElements = colors.size();
+    result._data.resize(colors.size() * 4);
+    for (size_t i = 0; i < colors.size(); i++) {
+        for (int c = 0; c < 4; c++)
+            result._data[4 * i + c] = _EncodeHalf(colors[i][c]);
+    }
+    return result;
+}
+
+HdOSPRayCompactArray
+HdOSPRayCompactArray::EncodeTexcoords(VtVec2fArray const& texcoords)
+{
+    HdOSPRayCompactArray result;
+    result._encoding = _Encoding::UNorm16x2;
+    result._numElements = texcoords.size();
+    result._data.resize(texcoords.size() * 2);
+    if (texcoords.empty())
+        return result;
+
+    GfVec2f minValue = texcoords[0];
+    GfVec2f maxValue = texcoords[0];
+    for (const GfVec2f& t : texcoords) {
+        for (int c = 0; c < 2; c++) {
+            minValue[c] = std::min(minValue[c], t[c]);
+            maxValue[c] = std::max(maxValue[c], t[c]);
+        }
+    }
+    result._offset = minValue;
+    for (int c = 0; c < 2; c++)
+        result._scale[c] = (maxValue[c] - minValue[c]) / 65535.f;
+
+    for (size_t i = 0; i < texcoords.size(); i++) {
+        for (int c = 0; c < 2; c++) {
+            const float scale = result._scale[c];
+            const float q = scale > 0.f
+                   ? (texcoords[i][c] - minValue[c]) / scale
+                   : 0.f;
+            result._data[2 * i + c]
+                   = uint16_t(std::max(0.f, std::min(65535.f, std::round(q))));
+        }
+    }
+    return result;
+}
+
+bool
+HdOSPRayCompactArray::Decode(VtVec3fArray* values) const
+{
+    if (_encoding == _Encoding::OctahedralNormal) {
+        values->resize(_numElements);
+        GfVec3f* dst = values->data();
+        for (size_t i = 0; i < _numElements; i++) {
+            float x = _DecodeSnorm16(_data[2 * i]);
+            float y = _DecodeSnorm16(_data[2 * i + 1]);
+            const float z = 1.f - std::abs(x) - std::abs(y);
+            const float t = std::max(-z, 0.f);
+            x += x >= 0.f ? -t : t;
+            y += y >= 0.f ? -t : t;
+            dst[i] = GfVec3f(x, y, z).GetNormalized();
+        }
+        return true;
+    }
+    if (_encoding == _Encoding::Half3) {
+        values->resize(_numElements);
+        GfVec3f* dst = values->data();
+        for (size_t i = 0; i < _numElements; i++) {
+            dst[i] = GfVec3f(_DecodeHalf(_data[3 * i]),
+                             _DecodeHalf(_data[3 * i + 1]),
+                             _DecodeHalf(_data[3 * i + 2]));
+        }
+        return true;
+    }
+    return false;
+}
+
+bool
+HdOSPRayCompactArray::Decode(VtVec4fArray* values) const
+{
+    if (_encoding != _Encoding::Half4)
+        return false;
+    values->resize(_numElements);
+    GfVec4f* dst = values->data();
+    for (size_t i = 0; i < _numElements; i++) {
+        dst[i] = GfVec4f(
+               _DecodeHalf(_data[4 * i]), _DecodeHalf(_data[4 * i + 1]),
+               _DecodeHalf(_data[4 * i + 2]), _DecodeHalf(_data[4 * i + 3]));
+    }
+    return true;
+}
+
+bool
+HdOSPRayCompactArray::Decode(VtVec2fArray* values) const
+{
+    if (_encoding != _Encoding::UNorm16x2)
+        return false;
+    values->resize(_numElements);
+    GfVec2f* dst = values->data();
+    for (size_t i = 0; i < _numElements; i++) {
+        dst[i] = GfVec2f(_offset[0] + _data[2 * i] * _scale[0],
+                         _offset[1] + _data[2 * i + 1] * _scale[1]);
+    }
+    return true;
+}
+
+size_t
+HdOSPRayCompactArray::GetDecodedByteSize() const
+{
+    switch (_encoding) {
+    case _Encoding::OctahedralNormal:
+    case _Encoding::Half3:
+        return _numElements * sizeof(GfVec3f);
+    case _Encoding::Half4:
+        return _numElements * sizeof(GfVec4f);
+    case _Encoding::UNorm16x2:
+        return _numElements * sizeof(GfVec2f);
+    default:
+        return 0;
+    }
+}
+
+bool
+HdOSPRayDeviceSharesHostArrays()
+{
+    return HdOSPRayConfig::GetInstance().device != "gpu";
+}
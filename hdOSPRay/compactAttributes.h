@@ -0,0 +1,82 @@
+// Copyright 2019 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <pxr/base/gf/vec2f.h>
+#include <pxr/base/gf/vec3f.h>
+#include <pxr/base/gf/vec4f.h>
+#include <pxr/base/vt/array.h>
+#include <pxr/base/vt/types.h>
+#include <pxr/pxr.h>
+
+#include <cstdint>
+#include <vector>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+/// \class HdOSPRayCompactArray
+///
+/// Reduced precision host copy of a vertex attribute array.  OSPRay geometries
+/// only accept float attributes, so rprims keep authored values in this form
+/// while OSPRay holds the expanded arrays, and decode them again when the
+/// geometry is rebuilt.  All encodings store 16 bit components:
+///
+/// - normals: octahedral mapping, 2 x snorm16 (4 instead of 12 bytes)
+/// - colors: half floats, 3 or 4 components
+/// - texcoords: unorm16 over the value range of the array, precision does
+///   not depend on the magnitude of the coordinates (e.g. UDIM tiles)
+///
+class HdOSPRayCompactArray {
+public:
+    HdOSPRayCompactArray() = default;
+
+    static HdOSPRayCompactArray EncodeNormals(VtVec3fArray const& normals);
+    static HdOSPRayCompactArray EncodeColors(VtVec3fArray const& colors);
+    static HdOSPRayCompactArray EncodeColors(VtVec4fArray const& colors);
+    static HdOSPRayCompactArray EncodeTexcoords(VtVec2fArray const& texcoords);
+
+    /// Decode into values.  The output type has to match the encoding,
+    /// returns false otherwise.
+    bool Decode(VtVec3fArray* values) const;
+    bool Decode(VtVec4fArray* values) const;
+    bool Decode(VtVec2fArray* values) const;
+
+    bool IsEmpty() const
+    {
+        return _numElements == 0;
+    }
+
+    size_t GetNumElements() const
+    {
+        return _numElements;
+    }
+
+    /// Host memory of the encoded values
+    size_t GetByteSize() const
+    {
+        return _data.size() * sizeof(uint16_t);
+    }
+
+    /// Host memory of the values in float format
+    size_t GetDecodedByteSize() const;
+
+    void Clear()
+    {
+        *this = HdOSPRayCompactArray();
+    }
+
+private:
+    enum class _Encoding { None, OctahedralNormal, Half3, Half4, UNorm16x2 };
+
+    _Encoding _encoding { _Encoding::None };
+    size_t _numElements { 0 };
+    std::vector<uint16_t> _data;
+    // texcoord range
+    GfVec2f _offset { 0.f };
+    GfVec2f _scale { 0.f };
+};
+
+/// Whether OSPRay reads shared host arrays in place.  Devices with their own
+/// memory copy shared data, which makes the host arrays redundant.
+bool HdOSPRayDeviceSharesHostArrays();
@@ -60,6 +60,54 @@ TF_DEFINE_ENV_SETTING(HDOSPRAY_PIXELFILTER_TYPE, (int) OSPPixelFilterType::OSP_P
 TF_DEFINE_ENV_SETTING(HDOSPRAY_FORCE_QUADRANGULATE, 0,
         "OSPRay force Quadrangulate meshes for debug");
 
+TF_DEFINE_ENV_SETTING(HDOSPRAY_QUAD_MESH_THRESHOLD, HDOSPRAY_DEFAULT_QUAD_MESH_THRESHOLD,
+        "Percentage of quad faces above which a mesh is emitted as quads instead of triangles.  0 disables quad meshes");
+
+TF_DEFINE_ENV_SETTING(HDOSPRAY_DEMOTE_FACE_VARYING, 1,
+        "Convert face-varying primvars to vertex interpolation, splitting vertices only along seams");
+
+TF_DEFINE_ENV_SETTING(HDOSPRAY_COMPACT_ATTRIBUTES, 0,
+        "Keep vertex attributes in reduced precision on the host wherever OSPRay does not read them in place");
+
+TF_DEFINE_ENV_SETTING(HDOSPRAY_LEAN_MEMORY, 0,
+        "Release host copies of geometry data OSPRay does not reference after commit");
+
+TF_DEFINE_ENV_SETTING(HDOSPRAY_ADAPTIVE_SUBDIVISION, 0,
+        "Pick the subdivision level of refined meshes from their projected screen size");
+
+TF_DEFINE_ENV_SETTING(HDOSPRAY_SUBDIVISION_EDGE_PIXELS, HDOSPRAY_DEFAULT_SUBDIVISION_EDGE_PIXELS,
+        "Target screen size of tessellated edges in pixels for adaptive subdivision");
+
+TF_DEFINE_ENV_SETTING(HDOSPRAY_SUBDIVISION_BUDGET, HDOSPRAY_DEFAULT_SUBDIVISION_BUDGET,
+        "Maximum number of tessellated quads of adaptive subdivision, in millions");
+
+TF_DEFINE_ENV_SETTING(HDOSPRAY_INTERACTIVE_PROXIES, 0,
+        "Render decimated proxies of heavy meshes while interacting");
+
+TF_DEFINE_ENV_SETTING(HDOSPRAY_PROXY_MIN_PRIMITIVES, HDOSPRAY_DEFAULT_PROXY_MIN_PRIMITIVES,
+        "Minimum number of primitives of a mesh to build an interactive proxy for");
+
+TF_DEFINE_ENV_SETTING(HDOSPRAY_PROXY_REDUCTION, HDOSPRAY_DEFAULT_PROXY_REDUCTION,
+        "Primitive count of a heavy mesh divided by the one of its interactive proxy");
+
+TF_DEFINE_ENV_SETTING(HDOSPRAY_RELEASE_HIDDEN_SECONDS, HDOSPRAY_DEFAULT_RELEASE_HIDDEN_SECONDS,
+        "Seconds after which hidden meshes release their OSPRay objects, 0 to keep them");
+
+TF_DEFINE_ENV_SETTING(HDOSPRAY_INTERACTIVE_STRAND_PERCENT, HDOSPRAY_DEFAULT_INTERACTIVE_STRAND_PERCENT,
+        "Percentage of the strands of dense curves rendered while interacting");
+
+TF_DEFINE_ENV_SETTING(HDOSPRAY_TEXTURE_CACHE_MB, HDOSPRAY_DEFAULT_TEXTURE_CACHE_MB,
+        "Megabytes of decoded textures kept in the texture cache");
+
+TF_DEFINE_ENV_SETTING(HDOSPRAY_MESH_BATCHING, 0,
+        "Merge small static meshes into batched geometries to reduce the number of instances");
+
+TF_DEFINE_ENV_SETTING(HDOSPRAY_MESH_BATCHING_MAX_PRIMITIVES, HDOSPRAY_DEFAULT_MESH_BATCHING_MAX_PRIMITIVES,
+        "Maximum number of triangles of a mesh to be batched");
+
+TF_DEFINE_ENV_SETTING(HDOSPRAY_MESH_BATCHING_GRID_RESOLUTION, HDOSPRAY_DEFAULT_MESH_BATCHING_GRID_RESOLUTION,
+        "Number of batching grid cells along the largest scene axis");
+
 TF_DEFINE_ENV_SETTING(HDOSPRAY_INTERACTIVE_TARGET_FPS, int(HDOSPRAY_DEFAULT_INTERACTIVE_TARGET_FPS),
         "set interactive scaling to match target fps when interacting.  0 Disables interactive scaling.");
 
@@ -85,6 +133,30 @@ HdOSPRayConfig::HdOSPRayConfig()
     useDenoiser = bool(TfGetEnvSetting(HDOSPRAY_USE_DENOISER) == 1);
     pixelFilterType = (OSPPixelFilterType) TfGetEnvSetting(HDOSPRAY_PIXELFILTER_TYPE);
     forceQuadrangulate = TfGetEnvSetting(HDOSPRAY_FORCE_QUADRANGULATE);
+    quadMeshThreshold = std::min(100,
+            std::max(0, TfGetEnvSetting(HDOSPRAY_QUAD_MESH_THRESHOLD))) / 100.f;
+    demoteFaceVarying = TfGetEnvSetting(HDOSPRAY_DEMOTE_FACE_VARYING) == 1;
+    compactAttributes = TfGetEnvSetting(HDOSPRAY_COMPACT_ATTRIBUTES) == 1;
+    leanMemory = TfGetEnvSetting(HDOSPRAY_LEAN_MEMORY) == 1;
+    adaptiveSubdivision = TfGetEnvSetting(HDOSPRAY_ADAPTIVE_SUBDIVISION) == 1;
+    subdivisionEdgePixels = std::max(1,
+            TfGetEnvSetting(HDOSPRAY_SUBDIVISION_EDGE_PIXELS));
+    subdivisionBudget = std::max(1,
+            TfGetEnvSetting(HDOSPRAY_SUBDIVISION_BUDGET));
+    interactiveProxies = TfGetEnvSetting(HDOSPRAY_INTERACTIVE_PROXIES) == 1;
+    proxyMinPrimitives = std::max(1,
+            TfGetEnvSetting(HDOSPRAY_PROXY_MIN_PRIMITIVES));
+    proxyReduction = std::max(2, TfGetEnvSetting(HDOSPRAY_PROXY_REDUCTION));
+    releaseHiddenSeconds = std::max(0,
+            TfGetEnvSetting(HDOSPRAY_RELEASE_HIDDEN_SECONDS));
+    interactiveStrandFraction = std::min(100, std::max(1,
+            TfGetEnvSetting(HDOSPRAY_INTERACTIVE_STRAND_PERCENT))) / 100.f;
+    textureCacheMB = std::max(0, TfGetEnvSetting(HDOSPRAY_TEXTURE_CACHE_MB));
+    meshBatching = TfGetEnvSetting(HDOSPRAY_MESH_BATCHING) == 1;
+    meshBatchingMaxPrimitives = std::max(0,
+            TfGetEnvSetting(HDOSPRAY_MESH_BATCHING_MAX_PRIMITIVES));
+    meshBatchingGridResolution = std::max(1,
+            TfGetEnvSetting(HDOSPRAY_MESH_BATCHING_GRID_RESOLUTION));
     maxDepth = TfGetEnvSetting(HDOSPRAY_MAX_PATH_DEPTH);
     useSimpleMaterial = TfGetEnvSetting(HDOSPRAY_USE_SIMPLE_MATERIAL);
 
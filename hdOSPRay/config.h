@@ -34,6 +34,16 @@ namespace opp = ospray::cpp;
 #define HDOSPRAY_DEFAULT_TMP_MIDIN 0.18f
 #define HDOSPRAY_DEFAULT_TMP_MIDOUT 0.18f
 #define HDOSPRAY_DEFAULT_TMP_ACESCOLOR false
+#define HDOSPRAY_DEFAULT_QUAD_MESH_THRESHOLD 75
+#define HDOSPRAY_DEFAULT_MESH_BATCHING_MAX_PRIMITIVES 4096
+#define HDOSPRAY_DEFAULT_MESH_BATCHING_GRID_RESOLUTION 16
+#define HDOSPRAY_DEFAULT_SUBDIVISION_EDGE_PIXELS 4
+#define HDOSPRAY_DEFAULT_SUBDIVISION_BUDGET 64
+#define HDOSPRAY_DEFAULT_PROXY_MIN_PRIMITIVES 1000000
+#define HDOSPRAY_DEFAULT_PROXY_REDUCTION 10
+#define HDOSPRAY_DEFAULT_RELEASE_HIDDEN_SECONDS 0
+#define HDOSPRAY_DEFAULT_INTERACTIVE_STRAND_PERCENT 100
+#define HDOSPRAY_DEFAULT_TEXTURE_CACHE_MB 2048
 
 PXR_NAMESPACE_USING_DIRECTIVE
 
@@ -101,6 +111,100 @@ public:
     /// Override with *HDOSPRAY_FORCE_QUADRANGULATE*.
     bool forceQuadrangulate;
 
+    ///  Fraction of quad faces above which a mesh is emitted as quads
+    ///  instead of triangles.  0 disables the heuristic.
+    ///
+    /// Override with *HDOSPRAY_QUAD_MESH_THRESHOLD* (in percent).
+    float quadMeshThreshold { HDOSPRAY_DEFAULT_QUAD_MESH_THRESHOLD / 100.f };
+
+    ///  Convert face-varying primvars to vertex interpolation where this
+    ///  saves memory, splitting vertices only along seams
+    ///
+    /// Override with *HDOSPRAY_DEMOTE_FACE_VARYING*.
+    bool demoteFaceVarying { true };
+
+    ///  Keep normals, colors and texcoords in reduced precision on the host
+    ///  wherever OSPRay does not read the float arrays in place
+    ///
+    /// Override with *HDOSPRAY_COMPACT_ATTRIBUTES*.
+    bool compactAttributes { false };
+
+    ///  Release host copies of geometry data OSPRay does not reference
+    ///  after commit and pull them again from the scene when needed
+    ///
+    /// Override with *HDOSPRAY_LEAN_MEMORY*.
+    bool leanMemory { false };
+
+    ///  Pick the subdivision level of refined meshes from their projected
+    ///  screen size instead of the display style refine level
+    ///
+    /// Override with *HDOSPRAY_ADAPTIVE_SUBDIVISION*.
+    bool adaptiveSubdivision { false };
+
+    ///  Target screen size of tessellated edges in pixels
+    ///
+    /// Override with *HDOSPRAY_SUBDIVISION_EDGE_PIXELS*.
+    int subdivisionEdgePixels { HDOSPRAY_DEFAULT_SUBDIVISION_EDGE_PIXELS };
+
+    ///  Upper bound of tessellated quads of all adaptive meshes, in millions
+    ///
+    /// Override with *HDOSPRAY_SUBDIVISION_BUDGET*.
+    int subdivisionBudget { HDOSPRAY_DEFAULT_SUBDIVISION_BUDGET };
+
+    ///  Render decimated proxies of heavy meshes while interacting
+    ///
+    /// Override with *HDOSPRAY_INTERACTIVE_PROXIES*.
+    bool interactiveProxies { false };
+
+    ///  Minimum number of primitives of a mesh to build a proxy for
+    ///
+    /// Override with *HDOSPRAY_PROXY_MIN_PRIMITIVES*.
+    int proxyMinPrimitives { HDOSPRAY_DEFAULT_PROXY_MIN_PRIMITIVES };
+
+    ///  Primitive count of the full mesh divided by the one of its proxy
+    ///
+    /// Override with *HDOSPRAY_PROXY_REDUCTION*.
+    int proxyReduction { HDOSPRAY_DEFAULT_PROXY_REDUCTION };
+
+    ///  Seconds after which hidden meshes release their OSPRay objects,
+    ///  0 keeps them
+    ///
+    /// Override with *HDOSPRAY_RELEASE_HIDDEN_SECONDS*.
+    int releaseHiddenSeconds { HDOSPRAY_DEFAULT_RELEASE_HIDDEN_SECONDS };
+
+    ///  Fraction of the strands of dense curves rendered while interacting,
+    ///  1 renders all strands
+    ///
+    /// Override with *HDOSPRAY_INTERACTIVE_STRAND_PERCENT*.
+    float interactiveStrandFraction {
+        HDOSPRAY_DEFAULT_INTERACTIVE_STRAND_PERCENT / 100.f
+    };
+
+    ///  Megabytes of decoded textures kept in the texture cache, textures
+    ///  no material references are evicted least recently used first
+    ///
+    /// Override with *HDOSPRAY_TEXTURE_CACHE_MB*.
+    int textureCacheMB { HDOSPRAY_DEFAULT_TEXTURE_CACHE_MB };
+
+    ///  Merge small static meshes into batched geometries
+    ///
+    /// Override with *HDOSPRAY_MESH_BATCHING*.
+    bool meshBatching { false };
+
+    ///  Maximum number of triangles of a mesh to be batched
+    ///
+    /// Override with *HDOSPRAY_MESH_BATCHING_MAX_PRIMITIVES*.
+    int meshBatchingMaxPrimitives {
+        HDOSPRAY_DEFAULT_MESH_BATCHING_MAX_PRIMITIVES
+    };
+
+    ///  Number of batching grid cells along the largest scene axis
+    ///
+    /// Override with *HDOSPRAY_MESH_BATCHING_GRID_RESOLUTION*.
+    int meshBatchingGridResolution {
+        HDOSPRAY_DEFAULT_MESH_BATCHING_GRID_RESOLUTION
+    };
+
     ///  Maximum ray depth
     ///
     /// Override with *HDOSPRAY_MAX_DEPTH*.
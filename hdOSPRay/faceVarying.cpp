@@ -0,0 +1,98 @@
+// Copyright 2019 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include "faceVarying.h"
+
+#include <cstring>
+
+void
+HdOSPRayFaceVaryingDemotion::AddPrimvar(const void* data, size_t numValues,
+                                        size_t valueSize)
+{
+    _primvars.push_back(
+           { static_cast<const char*>(data), numValues, valueSize });
+}
+
+bool
+HdOSPRayFaceVaryingDemotion::_CornersMatch(int cornerA, int cornerB) const
+{
+    for (const _Primvar& primvar : _primvars) {
+        if (std::memcmp(primvar.data + cornerA * primvar.valueSize,
+                        primvar.data + cornerB * primvar.valueSize,
+                        primvar.valueSize)
+            != 0)
+            return false;
+    }
+    return true;
+}
+
+bool
+HdOSPRayFaceVaryingDemotion::Compute(HdMeshTopology const& topology,
+                                     size_t numPoints, size_t vertexBytes)
+{
+    _numPoints = numPoints;
+    _vertexSources.clear();
+    _vertexCorners.clear();
+
+    const VtIntArray& faceVertexIndices = topology.GetFaceVertexIndices();
+    const size_t numCorners = faceVertexIndices.size();
+    if (_primvars.empty() || numCorners == 0)
+        return false;
+
+    size_t faceVaryingBytes = 0;
+    for (const _Primvar& primvar : _primvars) {
+        if (primvar.numValues != numCorners)
+            return false;
+        faceVaryingBytes += primvar.valueSize;
+    }
+
+    _vertexSources.resize(numPoints);
+    _vertexCorners.assign(numPoints, -1);
+    for (size_t i = 0; i < numPoints; i++)
+        _vertexSources[i] = i;
+    // next vertex with the same source point but different corner values
+    std::vector<int> nextSplit(numPoints, -1);
+
+    VtIntArray indices(numCorners);
+    for (size_t corner = 0; corner < numCorners; corner++) {
+        const int point = faceVertexIndices[corner];
+        if (point < 0 || size_t(point) >= numPoints)
+            return false;
+
+        int vertex = point;
+        if (_vertexCorners[vertex] < 0) {
+            _vertexCorners[vertex] = corner;
+        } else {
+            while (!_CornersMatch(_vertexCorners[vertex], corner)) {
+                if (nextSplit[vertex] < 0) {
+                    nextSplit[vertex] = _vertexSources.size();
+                    _vertexSources.push_back(point);
+                    _vertexCorners.push_back(corner);
+                    nextSplit.push_back(-1);
+                }
+                vertex = nextSplit[vertex];
+            }
+        }
+        indices[corner] = vertex;
+    }
+
+    // split vertices duplicate the points and all vertex primvars
+    const size_t numVertices = _vertexSources.size();
+    const size_t demotedBytes = numVertices * faceVaryingBytes
+           + (numVertices - numPoints) * vertexBytes;
+    if (demotedBytes >= numCorners * faceVaryingBytes)
+        return false;
+
+    if (!IsSplit()) {
+        _topology = topology;
+        return true;
+    }
+
+    _topology = HdMeshTopology(topology.GetScheme(), topology.GetOrientation(),
+                               topology.GetFaceVertexCounts(), indices,
+                               topology.GetHoleIndices(),
+                               topology.GetRefineLevel());
+    _topology.SetSubdivTags(topology.GetSubdivTags());
+    _topology.SetGeomSubsets(topology.GetGeomSubsets());
+    return true;
+}
@@ -0,0 +1,106 @@
+// Copyright 2019 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <pxr/base/vt/array.h>
+#include <pxr/imaging/hd/meshTopology.h>
+#include <pxr/pxr.h>
+
+#include <vector>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+/// \class HdOSPRayFaceVaryingDemotion
+///
+/// Converts face-varying primvars to vertex interpolation.  Corners sharing a
+/// vertex and carrying identical values for all added primvars are welded;
+/// vertices with differing corner values (e.g. along UV seams) are split, so
+/// only seam vertices are duplicated.  The first value set of a vertex keeps
+/// the original vertex index, split copies are appended after the original
+/// points.
+///
+/// Usage: AddPrimvar for every face-varying primvar, Compute, then
+/// DemotePrimvar for the face-varying and RemapVertexPrimvar for the points
+/// and vertex primvars, together with GetTopology for the indices.
+///
+class HdOSPRayFaceVaryingDemotion {
+public:
+    HdOSPRayFaceVaryingDemotion() = default;
+
+    /// Add a face-varying primvar with one value of valueSize bytes per
+    /// face-vertex.  data must stay valid until Compute returns.
+    void AddPrimvar(const void* data, size_t numValues, size_t valueSize);
+
+    /// Build the vertex mapping for topology.  vertexBytes is the size of
+    /// all per-vertex data that is duplicated for a split vertex.  Returns
+    /// false if the primvars do not match the topology or if demotion would
+    /// not save memory.
+    bool Compute(HdMeshTopology const& topology, size_t numPoints,
+                 size_t vertexBytes);
+
+    /// Whether vertices were split and the topology was remapped.
+    bool IsSplit() const
+    {
+        return _vertexSources.size() != _numPoints;
+    }
+
+    size_t GetNumVertices() const
+    {
+        return _vertexSources.size();
+    }
+
+    /// Topology indexing the demoted vertices.  Faces are unchanged.
+    HdMeshTopology const& GetTopology() const
+    {
+        return _topology;
+    }
+
+    /// One value per demoted vertex from a face-varying primvar added
+    /// before Compute.
+    template <class T>
+    VtArray<T> DemotePrimvar(VtArray<T> const& faceVarying) const
+    {
+        VtArray<T> result(_vertexCorners.size());
+        T* dst = result.data();
+        for (size_t i = 0; i < _vertexCorners.size(); i++) {
+            const int corner = _vertexCorners[i];
+            if (corner >= 0 && size_t(corner) < faceVarying.size())
+                dst[i] = faceVarying[corner];
+        }
+        return result;
+    }
+
+    /// Points or vertex primvar extended by the split vertices.  Returns an
+    /// empty array if values does not have one entry per original point.
+    template <class T>
+    VtArray<T> RemapVertexPrimvar(VtArray<T> const& values) const
+    {
+        if (values.size() != _numPoints)
+            return VtArray<T>();
+        if (!IsSplit())
+            return values;
+        VtArray<T> result(_vertexSources.size());
+        T* dst = result.data();
+        for (size_t i = 0; i < _vertexSources.size(); i++)
+            dst[i] = values[_vertexSources[i]];
+        return result;
+    }
+
+private:
+    struct _Primvar {
+        const char* data;
+        size_t numValues;
+        size_t valueSize;
+    };
+
+    bool _CornersMatch(int cornerA, int cornerB) const;
+
+    std::vector<_Primvar> _primvars;
+    size_t _numPoints { 0 };
+    HdMeshTopology _topology;
+    // per demoted vertex: source point and representative corner (-1 if the
+    // point is not referenced)
+    std::vector<int> _vertexSources;
+    std::vector<int> _vertexCorners;
+};
@@ -7,19 +7,32 @@
 #include "sampler.h"
 
 #include <pxr/base/gf/matrix4d.h>
+#include <pxr/base/gf/matrix4f.h>
 #include <pxr/base/gf/quaternion.h>
 #include <pxr/base/gf/quath.h>
 #include <pxr/base/gf/rotation.h>
 #include <pxr/base/gf/vec3f.h>
 #include <pxr/base/gf/vec4f.h>
 #include <pxr/base/tf/staticTokens.h>
+#include <pxr/base/work/loops.h>
+#include <pxr/base/work/withScopedParallelism.h>
+#include <pxr/imaging/hd/tokens.h>
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace rkcommon::math;
 
 // clang-format off
 TF_DEFINE_PRIVATE_TOKENS(
     _tokens,
+    (ids)
     (instanceTransform)
+    (invisibleIds)
+    (mask)
     (rotate)
     (scale)
     (translate)
@@ -56,6 +69,17 @@ HdOSPRayInstancer::Sync(HdSceneDelegate* delegate, HdRenderParam* renderParam,
     if (HdChangeTracker::IsAnyPrimvarDirty(*dirtyBits, GetId())) {
         _SyncPrimvars(delegate, *dirtyBits);
     }
+
+    // transforms are recomputed once on first use by any prototype.
+    // invisibleIds are pulled along with the transforms.
+    if (*dirtyBits
+        & (HdChangeTracker::DirtyPrimvar | HdChangeTracker::DirtyTransform
+           | HdChangeTracker::DirtyVisibility
+           | HdChangeTracker::DirtyInstanceIndex
+           | HdChangeTracker::DirtyInstancer)) {
+        std::lock_guard<std::mutex> lock(_instanceLock);
+        _transformsDirty = true;
+    }
 }
 #endif
 
@@ -105,7 +129,12 @@ HdOSPRayInstancer::_SyncPrimvars(HdSceneDelegate* delegate,
     HdPrimvarDescriptorVector primvars
            = delegate->GetPrimvarDescriptors(id, HdInterpolationInstance);
 
+    _colorPrimvar = TfToken();
     for (HdPrimvarDescriptor const& pv : primvars) {
+        if (pv.name == HdTokens->displayColor
+            || (pv.role == HdPrimvarRoleTokens->color
+                && _colorPrimvar.IsEmpty()))
+            _colorPrimvar = pv.name;
         if (HdChangeTracker::IsPrimvarDirty(dirtyBits, id, pv.name)) {
             VtValue value = delegate->Get(id, pv.name);
             if (!value.IsEmpty()) {
@@ -119,104 +148,587 @@ HdOSPRayInstancer::_SyncPrimvars(HdSceneDelegate* delegate,
 }
 #endif
 
-VtMatrix4dArray
+std::vector<affine3f>
 HdOSPRayInstancer::ComputeInstanceTransforms(SdfPath const& prototypeId)
 {
     HD_TRACE_FUNCTION();
     HF_MALLOC_TAG_FUNCTION();
 
-    GfMatrix4d instancerTransform
-           = GetDelegate()->GetInstancerTransform(GetId());
     VtIntArray instanceIndices
            = GetDelegate()->GetInstanceIndices(GetId(), prototypeId);
 
-    VtMatrix4dArray transforms(instanceIndices.size());
-    for (size_t i = 0; i < instanceIndices.size(); ++i) {
-        transforms[i] = instancerTransform;
+    std::lock_guard<std::mutex> lock(_instanceLock);
+#if HD_API_VERSION < 36
+    // without an instancer sync changes are not tracked
+    _transformsDirty = true;
+#endif
+    _UpdateTransforms();
+    return _GatherTransforms(instanceIndices);
+}
+
+std::vector<unsigned char>
+HdOSPRayInstancer::ComputeInstanceMask(SdfPath const& prototypeId)
+{
+    HD_TRACE_FUNCTION();
+
+    VtIntArray instanceIndices
+           = GetDelegate()->GetInstanceIndices(GetId(), prototypeId);
+
+    std::lock_guard<std::mutex> lock(_instanceLock);
+    _UpdateTransforms();
+    return _GatherMask(instanceIndices);
+}
+
+int
+HdOSPRayInstancer::_UpdateTransforms()
+{
+    bool changed = false;
+    if (_transformsDirty) {
+        _ComputeLocalTransforms();
+        _ComputeLocalMask();
+        _transformsDirty = false;
+        changed = true;
     }
 
-    // translate
-    if (_primvarMap.count(_tokens->translate) > 0) {
-        HdOSPRayBufferSampler sampler(*_primvarMap[_tokens->translate]);
-        for (size_t i = 0; i < instanceIndices.size(); ++i) {
-            GfVec3f translate;
-            if (sampler.Sample(instanceIndices[i], &translate)) {
-                GfMatrix4d translateMat(1);
-                translateMat.SetTranslate(GfVec3d(translate));
-                transforms[i] = translateMat * transforms[i];
+    if (!GetParentId().IsEmpty()) {
+        HdInstancer* parentInstancer
+               = GetDelegate()->GetRenderIndex().GetInstancer(GetParentId());
+        if (TF_VERIFY(parentInstancer)) {
+            // the parent keeps its own cache, it is only gathered again if
+            // it changed
+            HdOSPRayInstancer* parent
+                   = static_cast<HdOSPRayInstancer*>(parentInstancer);
+            std::lock_guard<std::mutex> parentLock(parent->_instanceLock);
+            const int parentVersion = parent->_UpdateTransforms();
+            if (parentVersion != _parentVersion) {
+                const VtIntArray parentIndices
+                       = GetDelegate()->GetInstanceIndices(GetParentId(),
+                                                           GetId());
+                _parentTransforms = parent->_GatherTransforms(parentIndices);
+                _parentMask = parent->_GatherMask(parentIndices);
+                _parentVersion = parentVersion;
+                changed = true;
             }
         }
+    } else if (_parentVersion != -1) {
+        _parentTransforms = std::vector<affine3f>();
+        _parentMask = std::vector<unsigned char>();
+        _parentVersion = -1;
+        changed = true;
     }
 
-    // rotate by quaternion
-    if (_primvarMap.count(_tokens->rotate) > 0) {
-        HdOSPRayBufferSampler sampler(*_primvarMap[_tokens->rotate]);
-        for (size_t i = 0; i < instanceIndices.size(); ++i) {
+    if (changed)
+        _version++;
+    return _version;
+}
+
+// Typed view of an instance primvar, nullptr if it is missing or of another
+// type
+template <typename T>
+static const T*
+_GetPrimvarData(
+       TfHashMap<TfToken, HdVtBufferSource*, TfToken::HashFunctor> const& map,
+       TfToken const& name, size_t* size)
+{
+    *size = 0;
+    auto it = map.find(name);
+    if (it == map.end()
+        || it->second->GetTupleType()
+               != HdOSPRayTypeHelper::GetTupleType<T>())
+        return nullptr;
+    *size = it->second->GetNumElements();
+    return static_cast<const T*>(it->second->GetData());
+}
+
+static affine3f
+_ToAffine(GfMatrix4f const& matrix)
+{
+    const float* m = matrix.GetArray();
+    return affine3f(vec3f(m[0], m[1], m[2]), vec3f(m[4], m[5], m[6]),
+                    vec3f(m[8], m[9], m[10]), vec3f(m[12], m[13], m[14]));
+}
+
+// Rotation of a quaternion with real part w, columns as in affine3f
+static linear3f
+_QuaternionToLinear(float w, float x, float y, float z)
+{
+    return linear3f(vec3f(1.f - 2.f * (y * y + z * z), 2.f * (x * y + z * w),
+                          2.f * (x * z - y * w)),
+                    vec3f(2.f * (x * y - z * w), 1.f - 2.f * (x * x + z * z),
+                          2.f * (y * z + x * w)),
+                    vec3f(2.f * (x * z + y * w), 2.f * (y * z - x * w),
+                          1.f - 2.f * (x * x + y * y)));
+}
+
+void
+HdOSPRayInstancer::_ComputeLocalTransforms()
+{
+    HD_TRACE_FUNCTION();
+
+    _instancerTransform = _ToAffine(
+           GfMatrix4f(GetDelegate()->GetInstancerTransform(GetId())));
+
+    size_t numTranslates, numRotates, numScales, numMatrices;
+    const GfVec3f* translates = _GetPrimvarData<GfVec3f>(
+           _primvarMap, _tokens->translate, &numTranslates);
 #if HD_API_VERSION > 35
-            GfQuath quath;
-            if (sampler.Sample(instanceIndices[i], &quath)) {
-                GfMatrix4d rotateMat(1);
-                GfQuatd quat(quath.GetReal(), quath.GetImaginary());
-                rotateMat.SetRotate(quat);
-                transforms[i] = rotateMat * transforms[i];
-            }
+    const GfQuath* rotates = _GetPrimvarData<GfQuath>(
+           _primvarMap, _tokens->rotate, &numRotates);
 #else
-            GfVec4f quat;
-            if (sampler.Sample(instanceIndices[i], &quat)) {
-                GfMatrix4d rotateMat(1);
-                rotateMat.SetRotate(GfRotation(GfQuaternion(
-                       quat[0], GfVec3d(quat[1], quat[2], quat[3]))));
-                transforms[i] = rotateMat * transforms[i];
-            }
+    const GfVec4f* rotates = _GetPrimvarData<GfVec4f>(
+           _primvarMap, _tokens->rotate, &numRotates);
+#endif
+    const GfVec3f* scales
+           = _GetPrimvarData<GfVec3f>(_primvarMap, _tokens->scale, &numScales);
+    const GfMatrix4d* matrices = _GetPrimvarData<GfMatrix4d>(
+           _primvarMap, _tokens->instanceTransform, &numMatrices);
+
+    const size_t numInstances
+           = std::max(std::max(numTranslates, numRotates),
+                      std::max(numScales, numMatrices));
+    _transforms.resize(numInstances);
+
+    // instancer * translate * rotate * scale * instanceTransform, applied
+    // right to left.  Primvars shorter than the instance count leave the
+    // remaining instances untransformed, as the sampler did.  _instanceLock
+    // is held and rprims are synced in parallel, the loop is isolated so
+    // waiting threads do not pick up syncs locking it again.
+    WorkWithScopedParallelism([&]() {
+        WorkParallelForN(numInstances, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                linear3f l(one);
+                if (i < numRotates) {
+#if HD_API_VERSION > 35
+                    const GfVec3h im = rotates[i].GetImaginary();
+                    l = _QuaternionToLinear(float(rotates[i].GetReal()),
+                                            float(im[0]), float(im[1]),
+                                            float(im[2]));
+#else
+                    const GfVec4f& q = rotates[i];
+                    l = _QuaternionToLinear(q[0], q[1], q[2], q[3]);
 #endif
+                }
+                if (i < numScales) {
+                    const GfVec3f& s = scales[i];
+                    l = linear3f(l.vx * s[0], l.vy * s[1], l.vz * s[2]);
+                }
+                affine3f xfm(l, vec3f(0.f));
+                if (i < numTranslates) {
+                    const GfVec3f& t = translates[i];
+                    xfm.p = vec3f(t[0], t[1], t[2]);
+                }
+                if (i < numMatrices)
+                    xfm = xfm * _ToAffine(GfMatrix4f(matrices[i]));
+                _transforms[i] = _instancerTransform * xfm;
+            }
+        });
+    });
+}
+
+void
+HdOSPRayInstancer::_ComputeLocalMask()
+{
+    _mask.clear();
+
+    size_t numMask = 0;
+    const bool* maskValues
+           = _GetPrimvarData<bool>(_primvarMap, _tokens->mask, &numMask);
+    const int* maskInts = maskValues
+           ? nullptr
+           : _GetPrimvarData<int>(_primvarMap, _tokens->mask, &numMask);
+
+    // invisibleIds are int64 on point instancers, but accepted as int
+    std::unordered_set<int64_t> invisibleIds;
+    const VtValue value = GetDelegate()->Get(GetId(), _tokens->invisibleIds);
+    if (value.IsHolding<VtInt64Array>()) {
+        for (int64_t id : value.UncheckedGet<VtInt64Array>())
+            invisibleIds.insert(id);
+    } else if (value.IsHolding<VtIntArray>()) {
+        for (int id : value.UncheckedGet<VtIntArray>())
+            invisibleIds.insert(id);
+    }
+
+    if (numMask == 0 && invisibleIds.empty())
+        return;
+
+    // instances are identified by the ids primvar if there is one, by
+    // their index otherwise
+    const size_t numInstances = _transforms.size();
+    _mask.assign(numInstances, 1);
+    for (size_t i = 0; i < std::min(numMask, numInstances); i++)
+        _mask[i] = maskValues ? maskValues[i] : (maskInts[i] != 0);
+    if (!invisibleIds.empty()) {
+        size_t numIds = 0;
+        const int* ids
+               = _GetPrimvarData<int>(_primvarMap, _tokens->ids, &numIds);
+        for (size_t i = 0; i < numInstances; i++) {
+            const int64_t id = i < numIds ? int64_t(ids[i]) : int64_t(i);
+            if (invisibleIds.count(id))
+                _mask[i] = 0;
         }
     }
+    if (std::find(_mask.begin(), _mask.end(), 0) == _mask.end())
+        _mask.clear();
+}
 
-    // scale
-    if (_primvarMap.count(_tokens->scale) > 0) {
-        HdOSPRayBufferSampler sampler(*_primvarMap[_tokens->scale]);
-        for (size_t i = 0; i < instanceIndices.size(); ++i) {
-            GfVec3f scale;
-            if (sampler.Sample(instanceIndices[i], &scale)) {
-                GfMatrix4d scaleMat(1);
-                scaleMat.SetScale(GfVec3d(scale));
-                transforms[i] = scaleMat * transforms[i];
-            }
+std::vector<vec4f>
+HdOSPRayInstancer::ComputeInstanceColors(SdfPath const& prototypeId)
+{
+    HD_TRACE_FUNCTION();
+
+    std::vector<vec4f> colors;
+    {
+        std::lock_guard<std::mutex> lock(_instanceLock);
+        size_t numColors = 0, numOpacities = 0;
+        const GfVec3f* rgb = nullptr;
+        const GfVec4f* rgba = nullptr;
+        if (!_colorPrimvar.IsEmpty()) {
+            rgb = _GetPrimvarData<GfVec3f>(_primvarMap, _colorPrimvar,
+                                           &numColors);
+            if (!rgb)
+                rgba = _GetPrimvarData<GfVec4f>(_primvarMap, _colorPrimvar,
+                                                &numColors);
+        }
+        const float* opacities = _GetPrimvarData<float>(
+               _primvarMap, HdTokens->displayOpacity, &numOpacities);
+        colors.assign(std::max(numColors, numOpacities), vec4f(1.f));
+        for (size_t i = 0; i < numColors; i++) {
+            colors[i] = rgb ? vec4f(rgb[i][0], rgb[i][1], rgb[i][2], 1.f)
+                            : vec4f(rgba[i][0], rgba[i][1], rgba[i][2],
+                                    rgba[i][3]);
         }
+        for (size_t i = 0; i < numOpacities; i++)
+            colors[i].w = opacities[i];
     }
+    return _GatherInstanceValues(prototypeId, colors, vec4f(1.f),
+                                 &HdOSPRayInstancer::ComputeInstanceColors);
+}
 
-    // transform
-    if (_primvarMap.count(_tokens->instanceTransform) > 0) {
-        HdOSPRayBufferSampler sampler(*_primvarMap[_tokens->instanceTransform]);
-        for (size_t i = 0; i < instanceIndices.size(); ++i) {
-            GfMatrix4d instanceTransform;
-            if (sampler.Sample(instanceIndices[i], &instanceTransform)) {
-                transforms[i] = instanceTransform * transforms[i];
+std::vector<unsigned int>
+HdOSPRayInstancer::ComputeInstanceIds(SdfPath const& prototypeId)
+{
+    HD_TRACE_FUNCTION();
+
+    std::vector<unsigned int> ids;
+    {
+        std::lock_guard<std::mutex> lock(_instanceLock);
+        size_t numIds = 0;
+        const int* values
+               = _GetPrimvarData<int>(_primvarMap, _tokens->ids, &numIds);
+        if (values)
+            ids.assign(values, values + numIds);
+    }
+    return _GatherInstanceValues(prototypeId, ids, 0u,
+                                 &HdOSPRayInstancer::ComputeInstanceIds);
+}
+
+template <typename T>
+std::vector<T>
+HdOSPRayInstancer::_GatherInstanceValues(
+       SdfPath const& prototypeId, std::vector<T> const& values,
+       T const& fallback,
+       std::vector<T> (HdOSPRayInstancer::*computeParent)(SdfPath const&))
+{
+    std::vector<T> parentValues;
+    size_t numParent = 1;
+    if (!GetParentId().IsEmpty()) {
+        HdInstancer* parentInstancer
+               = GetDelegate()->GetRenderIndex().GetInstancer(GetParentId());
+        if (parentInstancer && values.empty())
+            parentValues = (static_cast<HdOSPRayInstancer*>(parentInstancer)
+                                   ->*computeParent)(GetId());
+        std::lock_guard<std::mutex> lock(_instanceLock);
+        _UpdateTransforms();
+        numParent = _parentTransforms.size();
+    }
+    if (values.empty() && parentValues.size() != numParent)
+        return std::vector<T>();
+
+    // same order as _GatherTransforms, grouped by parent instance
+    const VtIntArray instanceIndices
+           = GetDelegate()->GetInstanceIndices(GetId(), prototypeId);
+    const size_t numLocal = instanceIndices.size();
+    std::vector<T> result(numParent * numLocal);
+    for (size_t k = 0; k < result.size(); k++) {
+        if (values.empty()) {
+            result[k] = parentValues[k / numLocal];
+            continue;
+        }
+        const int index = instanceIndices[k % numLocal];
+        result[k] = (index >= 0 && size_t(index) < values.size())
+               ? values[index]
+               : fallback;
+    }
+    return result;
+}
+
+std::vector<affine3f>
+HdOSPRayInstancer::_GatherTransforms(VtIntArray const& instanceIndices) const
+{
+    const bool nested = !GetParentId().IsEmpty();
+    const size_t numLocal = instanceIndices.size();
+    const size_t numParent = nested ? _parentTransforms.size() : 1;
+
+    // nested transforms of the form parent * local, grouped by parent
+    std::vector<affine3f> transforms(numParent * numLocal);
+    // called with _instanceLock held, see _ComputeLocalTransforms
+    WorkWithScopedParallelism([&]() {
+        WorkParallelForN(transforms.size(), [&](size_t begin, size_t end) {
+            for (size_t k = begin; k < end; k++) {
+                const int index = instanceIndices[k % numLocal];
+                const affine3f& local
+                       = (index >= 0 && size_t(index) < _transforms.size())
+                       ? _transforms[index]
+                       : _instancerTransform;
+                transforms[k] = nested
+                       ? _parentTransforms[k / numLocal] * local
+                       : local;
             }
+        });
+    });
+    return transforms;
+}
+
+std::vector<unsigned char>
+HdOSPRayInstancer::_GatherMask(VtIntArray const& instanceIndices) const
+{
+    const bool nested = !GetParentId().IsEmpty();
+    const bool parentMask = nested
+           && _parentMask.size() == _parentTransforms.size()
+           && !_parentMask.empty();
+    if (_mask.empty() && !parentMask)
+        return std::vector<unsigned char>();
+
+    const size_t numLocal = instanceIndices.size();
+    const size_t numParent = nested ? _parentTransforms.size() : 1;
+    std::vector<unsigned char> mask(numParent * numLocal, 1);
+    bool hidden = false;
+    for (size_t k = 0; k < mask.size(); k++) {
+        const int index = instanceIndices[k % numLocal];
+        if ((index >= 0 && size_t(index) < _mask.size() && !_mask[index])
+            || (parentMask && !_parentMask[k / numLocal])) {
+            mask[k] = 0;
+            hidden = true;
         }
     }
+    if (!hidden)
+        return std::vector<unsigned char>();
+    return mask;
+}
+
+#if HDOSPRAY_INSTANCE_ARRAYS
+// Set the transforms not hidden by mask on an array instance.  Returns false
+// if all of them are hidden.
+static bool
+_SetTransformArray(opp::Instance& instance,
+                   std::vector<affine3f> const& transforms,
+                   std::vector<unsigned char> const& mask)
+{
+    // copied, transforms of the prototypes are recomputed in place
+    if (mask.size() != transforms.size()) {
+        instance.setParam("transform",
+                          opp::CopiedData(transforms.data(), OSP_AFFINE3F,
+                                          transforms.size()));
+        return true;
+    }
+    std::vector<affine3f> visible;
+    visible.reserve(transforms.size());
+    for (size_t i = 0; i < transforms.size(); i++) {
+        if (mask[i])
+            visible.push_back(transforms[i]);
+    }
+    if (visible.empty())
+        return false;
+    instance.setParam("transform",
+                      opp::CopiedData(visible.data(), OSP_AFFINE3F,
+                                      visible.size()));
+    return true;
+}
+#endif
+
+void
+HdOSPRayCreateInstances(opp::Group group,
+                        std::vector<affine3f> const& transforms,
+                        std::vector<opp::Instance>& instances,
+                        std::vector<unsigned int> const& ids,
+                        std::vector<unsigned char> const& mask)
+{
+    const bool hasIds = (ids.size() == transforms.size());
+#if HDOSPRAY_INSTANCE_ARRAYS
+    if (transforms.size() > 1 && !hasIds) {
+        opp::Instance instance(group);
+        if (!_SetTransformArray(instance, transforms, mask))
+            return;
+        instance.commit();
+        instances.push_back(instance);
+        return;
+    }
+#else
+    (void)mask;
+#endif
+    instances.reserve(instances.size() + transforms.size());
+    for (size_t i = 0; i < transforms.size(); i++) {
+        opp::Instance instance(group);
+        instance.setParam("transform", transforms[i]);
+        instance.setParam("id", hasIds ? ids[i] : (unsigned int)i);
+        instance.commit();
+        instances.push_back(instance);
+    }
+}
+
+// distinct instance colors, each costs a group and its BVH
+static constexpr size_t _maxInstanceColors = 256;
+
+void
+HdOSPRayCreateColoredInstances(
+       std::function<opp::GeometricModel()> const& createModel,
+       std::vector<affine3f> const& transforms,
+       std::vector<vec4f> const& colors, std::vector<unsigned int> const& ids,
+       std::vector<opp::Instance>& instances,
+       std::vector<unsigned char> const& mask)
+{
+    auto hidden = [&](size_t i) {
+        return mask.size() == transforms.size() && !mask[i];
+    };
 
-    if (GetParentId().IsEmpty()) {
-        return transforms;
+    // quantize colors coarser until they fit into the color budget
+    std::vector<uint32_t> buckets(transforms.size());
+    std::unordered_map<uint32_t, uint32_t> keys;
+    for (int bits = 8; bits > 0; bits--) {
+        const float levels = float((1 << bits) - 1);
+        auto quantize = [levels](float value) {
+            return uint32_t(std::max(0.f, std::min(1.f, value)) * levels
+                            + .5f);
+        };
+        keys.clear();
+        for (size_t i = 0; i < transforms.size(); i++) {
+            if (hidden(i))
+                continue;
+            const vec4f& c = colors[i];
+            const uint32_t key = quantize(c.x)
+                   | (quantize(c.y) << bits) | (quantize(c.z) << (2 * bits))
+                   | (quantize(c.w) << (3 * bits));
+            buckets[i] = keys.emplace(key, uint32_t(keys.size())).first->second;
+            if (keys.size() > _maxInstanceColors && bits > 1)
+                break;
+        }
+        if (keys.size() <= _maxInstanceColors || bits == 1)
+            break;
     }
 
-    HdInstancer* parentInstancer
-           = GetDelegate()->GetRenderIndex().GetInstancer(GetParentId());
-    if (!TF_VERIFY(parentInstancer)) {
-        return transforms;
+    // every bucket is shown in the mean color of its instances
+    const size_t numBuckets = keys.size();
+    std::vector<vec4f> bucketColors(numBuckets, vec4f(0.f));
+    std::vector<std::vector<affine3f>> bucketTransforms(numBuckets);
+    std::vector<std::vector<unsigned int>> bucketIds(numBuckets);
+    const bool hasIds = (ids.size() == transforms.size());
+    for (size_t i = 0; i < transforms.size(); i++) {
+        if (hidden(i))
+            continue;
+        const uint32_t b = buckets[i];
+        bucketColors[b] += colors[i];
+        bucketTransforms[b].push_back(transforms[i]);
+        if (hasIds)
+            bucketIds[b].push_back(ids[i]);
+    }
+    for (size_t b = 0; b < numBuckets; b++) {
+        opp::GeometricModel model = createModel();
+        model.setParam("color",
+                       bucketColors[b] / float(bucketTransforms[b].size()));
+        model.commit();
+        opp::Group group;
+        group.setParam("geometry", opp::CopiedData(model));
+        group.commit();
+        // without ids, every bucket is an instance array
+        HdOSPRayCreateInstances(group, bucketTransforms[b], instances,
+                                hasIds ? bucketIds[b]
+                                       : std::vector<unsigned int>());
     }
+}
 
-    // compute nested transforms of the form parent * local
-    VtMatrix4dArray parentTransforms
-           = static_cast<HdOSPRayInstancer*>(parentInstancer)
-                    ->ComputeInstanceTransforms(GetId());
+bool
+HdOSPRayUpdateInstances(opp::Group group,
+                        std::vector<affine3f> const& previousTransforms,
+                        std::vector<affine3f> const& transforms,
+                        std::vector<opp::Instance>& instances,
+                        std::vector<unsigned char> const& previousMask,
+                        std::vector<unsigned char> const& mask)
+{
+    auto changed = [&](size_t i) {
+        return std::memcmp(&previousTransforms[i], &transforms[i],
+                           sizeof(affine3f))
+               != 0;
+    };
 
-    VtMatrix4dArray final(parentTransforms.size() * transforms.size());
-    for (size_t i = 0; i < parentTransforms.size(); ++i) {
-        for (size_t j = 0; j < transforms.size(); ++j) {
-            final[i * transforms.size() + j]
-                   = transforms[j] * parentTransforms[i];
+#if HDOSPRAY_INSTANCE_ARRAYS
+    if (instances.size() == 1 && previousTransforms.size() > 1
+        && transforms.size() > 1) {
+        // the array instance is kept, its transforms are replaced if any
+        // of them or the mask changed
+        bool anyChanged = previousTransforms.size() != transforms.size()
+               || previousMask != mask;
+        for (size_t i = 0; !anyChanged && i < transforms.size(); i++)
+            anyChanged = changed(i);
+        if (anyChanged) {
+            if (!_SetTransformArray(instances[0], transforms, mask)) {
+                instances.clear();
+                return true;
+            }
+            instances[0].commit();
         }
+        return false;
     }
-    return final;
-}
\ No newline at end of file
+    const bool perTransform = transforms.size() <= 1
+           && previousTransforms.size() <= 1;
+#else
+    const bool perTransform = true;
+#endif
+    if (!perTransform || instances.size() != previousTransforms.size()) {
+        instances.clear();
+        HdOSPRayCreateInstances(group, transforms, instances, {}, mask);
+        return true;
+    }
+
+    const size_t numKept = std::min(previousTransforms.size(),
+                                    transforms.size());
+    for (size_t i = 0; i < numKept; i++) {
+        if (changed(i)) {
+            instances[i].setParam("transform", transforms[i]);
+            instances[i].commit();
+        }
+    }
+    // hidden instances are kept and filtered when they are collected
+    if (transforms.size() == previousTransforms.size())
+        return previousMask != mask;
+
+    if (transforms.size() < instances.size()) {
+        instances.erase(instances.begin() + transforms.size(),
+                        instances.end());
+        return true;
+    }
+    instances.reserve(transforms.size());
+    for (size_t i = numKept; i < transforms.size(); i++) {
+        opp::Instance instance(group);
+        instance.setParam("transform", transforms[i]);
+        instance.setParam("id", (unsigned int)i);
+        instance.commit();
+        instances.push_back(instance);
+    }
+    return true;
+}
+
+void
+HdOSPRayAppendVisibleInstances(std::vector<opp::Instance> const& instances,
+                               std::vector<unsigned char> const& mask,
+                               std::vector<opp::Instance>& instanceList)
+{
+    if (mask.size() != instances.size()) {
+        instanceList.insert(instanceList.end(), instances.begin(),
+                            instances.end());
+        return;
+    }
+    for (size_t i = 0; i < instances.size(); i++) {
+        if (mask[i])
+            instanceList.push_back(instances[i]);
+    }
+}
@@ -11,10 +11,78 @@
 #include <pxr/base/tf/hashmap.h>
 #include <pxr/base/tf/token.h>
 
+#include <ospray/ospray_cpp.h>
+#include <ospray/ospray_cpp/ext/rkcommon.h>
+#include <ospray/version.h>
+#include <rkcommon/math/AffineSpace.h>
+
+#include <functional>
 #include <mutex>
+#include <vector>
+
+namespace opp = ospray::cpp;
+
+// OSPRay 3.2 instances take an array of transforms, which instances their
+// group once per transform
+#if OSPRAY_VERSION_MAJOR > 3                                                   \
+       || (OSPRAY_VERSION_MAJOR == 3 && OSPRAY_VERSION_MINOR >= 2)
+#define HDOSPRAY_INSTANCE_ARRAYS 1
+#else
+#define HDOSPRAY_INSTANCE_ARRAYS 0
+#endif
 
 PXR_NAMESPACE_USING_DIRECTIVE
 
+/// Append instances of group for all transforms to instances.  With instance
+/// arrays a single instance holds all transforms.  Otherwise one instance
+/// per transform is created, OSPRay groups cannot hold instances to build a
+/// hierarchy from.  Instances get their index as id unless ids are given.
+/// Transforms hidden by mask are left out of instance arrays, per transform
+/// instances are created for all of them and filtered by
+/// HdOSPRayAppendVisibleInstances, so toggling does not recreate them.
+void HdOSPRayCreateInstances(opp::Group group,
+                             std::vector<rkcommon::math::affine3f> const&
+                                    transforms,
+                             std::vector<opp::Instance>& instances,
+                             std::vector<unsigned int> const& ids = {},
+                             std::vector<unsigned char> const& mask = {});
+
+/// Append instances with a color each.  OSPRay instances cannot carry
+/// attributes, so instances are bucketed by color and every bucket gets a
+/// group with a geometric model of its color.  createModel returns a new
+/// model of the prototype; all models share its geometry.  The number of
+/// buckets is bounded by quantizing colors, as every group has a BVH.
+/// Transforms hidden by mask are left out.
+void HdOSPRayCreateColoredInstances(
+       std::function<opp::GeometricModel()> const& createModel,
+       std::vector<rkcommon::math::affine3f> const& transforms,
+       std::vector<rkcommon::math::vec4f> const& colors,
+       std::vector<unsigned int> const& ids,
+       std::vector<opp::Instance>& instances,
+       std::vector<unsigned char> const& mask = {});
+
+/// Update instances of group created for previousTransforms and
+/// previousMask to transforms and mask.  Only instances whose transform
+/// changed are recommitted, instances are added or removed at the tail.
+/// Returns true if the instances to render changed, i.e. instances were
+/// added or removed or the mask of per transform instances changed, false
+/// if existing instances were updated in place.
+bool HdOSPRayUpdateInstances(
+       opp::Group group,
+       std::vector<rkcommon::math::affine3f> const& previousTransforms,
+       std::vector<rkcommon::math::affine3f> const& transforms,
+       std::vector<opp::Instance>& instances,
+       std::vector<unsigned char> const& previousMask = {},
+       std::vector<unsigned char> const& mask = {});
+
+/// Append the instances not hidden by mask to instanceList.  The mask only
+/// applies to instances created per transform, other instances already
+/// leave out hidden transforms and are appended as they are.
+void HdOSPRayAppendVisibleInstances(
+       std::vector<opp::Instance> const& instances,
+       std::vector<unsigned char> const& mask,
+       std::vector<opp::Instance>& instanceList);
+
 class HdOSPRayInstancer : public HdInstancer {
 public:
 #if HD_API_VERSION < 36
@@ -35,9 +103,57 @@ public:
               HdDirtyBits* dirtyBits) override;
 #endif
 
-    VtMatrix4dArray ComputeInstanceTransforms(SdfPath const& prototypeId);
+    /// Transforms of the instances of prototypeId, composed with the
+    /// transforms of parent instancers.  The transforms of all instances are
+    /// computed once per sync and shared by all prototypes.  Thread safe.
+    std::vector<rkcommon::math::affine3f> ComputeInstanceTransforms(
+           SdfPath const& prototypeId);
+
+    /// Colors of the instances of prototypeId, in the order of
+    /// ComputeInstanceTransforms, from the instance-rate displayColor or
+    /// other color primvar and displayOpacity.  Empty if neither this
+    /// instancer nor its parents have one.  Thread safe.
+    std::vector<rkcommon::math::vec4f> ComputeInstanceColors(
+           SdfPath const& prototypeId);
+
+    /// Ids of the instances of prototypeId from the instance-rate ids
+    /// primvar, empty if there is none.  Thread safe.
+    std::vector<unsigned int> ComputeInstanceIds(SdfPath const& prototypeId);
+
+    /// Visibility of the instances of prototypeId, in the order of
+    /// ComputeInstanceTransforms, 0 for instances hidden by the
+    /// instance-rate mask primvar or by invisibleIds of this instancer or
+    /// its parents.  Empty if all instances are visible.  Thread safe.
+    std::vector<unsigned char> ComputeInstanceMask(SdfPath const& prototypeId);
 
 private:
+    /// Recompute dirty instance transforms and fetch the transforms of this
+    /// instancer from its parent if they changed.  Returns the version of
+    /// the cached transforms.  _instanceLock must be held.
+    int _UpdateTransforms();
+    /// Compute the transforms of all instances from the primvars
+    void _ComputeLocalTransforms();
+    /// Compute the visibility of all instances from the mask primvar and
+    /// invisibleIds, after _ComputeLocalTransforms
+    void _ComputeLocalMask();
+    /// Transforms of the given instances, composed with the parent
+    /// transforms.  _instanceLock must be held.
+    std::vector<rkcommon::math::affine3f> _GatherTransforms(
+           VtIntArray const& instanceIndices) const;
+    /// Visibility of the given instances, combined with the parent
+    /// visibility.  _instanceLock must be held.
+    std::vector<unsigned char> _GatherMask(
+           VtIntArray const& instanceIndices) const;
+    /// Values of the instances of prototypeId from values of all instances
+    /// of this instancer, or from the parent's values of this instancer if
+    /// there are none
+    template <typename T>
+    std::vector<T> _GatherInstanceValues(
+           SdfPath const& prototypeId, std::vector<T> const& values,
+           T const& fallback,
+           std::vector<T> (HdOSPRayInstancer::*computeParent)(
+                  SdfPath const&));
+
 #if HD_API_VERSION < 36
     void _SyncPrimvars();
 #else
@@ -48,6 +164,22 @@ private:
 
     // map of primvar name to data buffer
     TfHashMap<TfToken, HdVtBufferSource*, TfToken::HashFunctor> _primvarMap;
+    // instance-rate color primvar, displayColor if there is one
+    TfToken _colorPrimvar;
+
+    // instancer transform composed with the primvar transforms of every
+    // instance, recomputed on first use after a sync changed them
+    bool _transformsDirty { true };
+    rkcommon::math::affine3f _instancerTransform { rkcommon::math::one };
+    std::vector<rkcommon::math::affine3f> _transforms;
+    // visibility of _transforms, empty if all instances are visible
+    std::vector<unsigned char> _mask;
+    // transforms and visibility of the parent instancer's instances of this
+    // instancer
+    std::vector<rkcommon::math::affine3f> _parentTransforms;
+    std::vector<unsigned char> _parentMask;
+    int _parentVersion { -1 };
+    int _version { 0 };
 
 private:
     // This class does not support copying.
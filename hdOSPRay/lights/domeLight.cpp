@@ -4,6 +4,7 @@
 #include "domeLight.h"
 #include "../config.h"
 #include "../texture.h"
+#include "../textureCache.h"
 
 #include <pxr/imaging/hd/perfLog.h>
 #include <pxr/imaging/hd/rprimCollection.h>
@@ -55,7 +56,8 @@ HdOSPRayDomeLight::_PrepareOSPLight()
     upDirection = _transform.Transform(upDirection);
     centerDirection = _transform.Transform(centerDirection);
 
-    _hdriTexture = LoadHioTexture2D(_textureFile);
+    _hdriTexture = HdOSPRayTextureCache::GetInstance().GetHioTexture2D(
+           _textureFile);
 
     if (_hdriTexture.ospTexture) {
         _ospLight = opp::Light("hdri");
@@ -4,6 +4,7 @@
 #include "material.h"
 #include "renderParam.h"
 #include "texture.h"
+#include "textureCache.h"
 
 #include <pxr/base/gf/vec3f.h>
 #include <pxr/imaging/hd/material.h>
@@ -137,6 +138,10 @@ HdOSPRayMaterial::Sync(HdSceneDelegate* sceneDelegate,
 
     // if material dirty, update
     if (*dirtyBits & HdMaterial::DirtyResource) {
+        _CancelTextureLoads();
+        _textureLoads = std::make_shared<_TextureLoads>();
+        _textureFallbacks.clear();
+
         //  find material network
         VtValue networkMapResource
                = sceneDelegate->GetMaterialResource(GetId());
@@ -213,7 +218,8 @@ HdOSPRayMaterial::Sync(HdSceneDelegate* sceneDelegate,
 
                 const TfToken inputNameToken = relationship->inputName;
                 const TfToken texNameToken = relationship->outputName;
-                _ProcessTextureNode(*node, inputNameToken, texNameToken);
+                _ProcessTextureNode(*node, inputNameToken, texNameToken,
+                                    ospRenderParam);
             } else if (node->identifier
                        == HdOSPRayMaterialTokens->UsdTransform2d) {
                 // calculate transform2d to be used on a texture
@@ -244,14 +250,85 @@ HdOSPRayMaterial::Sync(HdSceneDelegate* sceneDelegate,
 
         _UpdateOSPRayMaterial();
 
+        ospRenderParam->SetMaterial(GetId(), _ospMaterial);
         ospRenderParam->UpdateMaterialVersion();
         *dirtyBits = Clean;
     }
 }
 
+HdOSPRayMaterial::~HdOSPRayMaterial()
+{
+    _CancelTextureLoads();
+    // release the references of the texture cache
+    _textures.clear();
+    HdOSPRayTextureCache::GetInstance().Trim();
+}
+
+void
+HdOSPRayMaterial::Finalize(HdRenderParam* renderParam)
+{
+    HdOSPRayRenderParam* ospRenderParam
+           = static_cast<HdOSPRayRenderParam*>(renderParam);
+    _CancelTextureLoads();
+    ospRenderParam->ResetMaterial(GetId());
+    ospRenderParam->UpdateMaterialVersion();
+}
+
+void
+HdOSPRayMaterial::_CancelTextureLoads()
+{
+    if (!_textureLoads)
+        return;
+    std::lock_guard<std::mutex> lock(_textureLoads->mutex);
+    _textureLoads->cancelled = true;
+}
+
+void
+HdOSPRayMaterial::_ApplyLoadedTextures(HdOSPRayRenderParam* renderParam)
+{
+    std::map<TfToken, HdOSPRayTexture> loaded;
+    {
+        std::lock_guard<std::mutex> lock(_textureLoads->mutex);
+        loaded.swap(_textureLoads->loaded);
+    }
+
+    // texture parameters of the node, e.g. its scale, are kept.  Textures
+    // that failed to load keep their fallback.
+    bool applied = false;
+    for (const auto& [name, result] : loaded) {
+        if (!result.ospTexture)
+            continue;
+        HdOSPRayTexture& texture = _textures[name];
+        texture.ospTexture = result.ospTexture;
+        texture.data = result.data;
+        if (result.hasXfm) {
+            texture.hasXfm = true;
+            texture.xfm_scale = result.xfm_scale;
+            texture.xfm_translation = result.xfm_translation;
+        }
+        _textureFallbacks.erase(name);
+        applied = true;
+    }
+    if (!applied)
+        return;
+
+    _UpdateOSPRayMaterial();
+    renderParam->SetMaterial(GetId(), _ospMaterial);
+    renderParam->UpdateMaterialVersion();
+}
+
 void
 HdOSPRayMaterial::_UpdateOSPRayMaterial()
 {
+    // base color textures that are still loading show their fallback
+    const GfVec3f authoredDiffuseColor = diffuseColor;
+    for (const auto& [name, value] : _textureFallbacks) {
+        if (name == HdOSPRayMaterialTokens->diffuseColor
+            || name == HdOSPRayMaterialTokens->baseColor
+            || name == HdOSPRayMaterialTokens->map_baseColor)
+            diffuseColor = GfVec3f(value[0], value[1], value[2]);
+    }
+
     std::string rendererType = HdOSPRayConfig::GetInstance().usePathTracing
            ? "pathtracer"
            : "scivis";
@@ -290,6 +367,7 @@ HdOSPRayMaterial::_UpdateOSPRayMaterial()
             _ospMaterial = opp::Material("obj");
         UpdateScivisMaterial(rendererType);
     }
+    diffuseColor = authoredDiffuseColor;
 
     _ospMaterial.commit();
 }
@@ -489,7 +567,8 @@ HdOSPRayMaterial::_ProcessOspGlassNode(HdMaterialNode node)
 void
 HdOSPRayMaterial::_ProcessTextureNode(HdMaterialNode node,
                                       const TfToken& inputName,
-                                      const TfToken& outputName)
+                                      const TfToken& outputName,
+                                      HdOSPRayRenderParam* renderParam)
 {
     bool isPtex = node.identifier == HdOSPRayMaterialTokens->HwPtexTexture_1;
     bool isUdim = false;
@@ -498,6 +577,7 @@ HdOSPRayMaterial::_ProcessTextureNode(HdMaterialNode node,
         _textures[outputName] = HdOSPRayTexture();
     HdOSPRayTexture& texture = _textures[outputName];
     std::string&& filename("");
+    bool hasFallback = false;
     TF_FOR_ALL (param, node.parameters) {
         const auto& name = param->first;
         const auto& value = param->second;
@@ -516,6 +596,7 @@ HdOSPRayMaterial::_ProcessTextureNode(HdMaterialNode node,
         } else if (name == HdOSPRayMaterialTokens->bias) {
         } else if (name == HdOSPRayMaterialTokens->fallback) {
             fallback = value.Get<GfVec4f>();
+            hasFallback = true;
         } else if (name == HdOSPRayMaterialTokens->sourceColorSpace) {
         }
     }
@@ -529,26 +610,70 @@ HdOSPRayMaterial::_ProcessTextureNode(HdMaterialNode node,
 #ifdef HDOSPRAY_PLUGIN_PTEX
             texture.ospTexture = LoadPtexTexture(texture.file);
 #endif
-        } else if (isUdim) {
-            int numX, numY;
-            const auto& result = LoadUDIMTexture2D(
-                   texture.file, numX, numY, false,
-                   (outputName == HdOSPRayMaterialTokens->opacity));
-            texture.ospTexture = result.ospTexture;
-            texture.data = result.data;
-            texture.hasXfm = true;
-            texture.xfm_scale = { 1.f / float(numX), 1.f / float(numY) };
-            // OSPRay scales around the center (0.5, 0.5).  translate
-            // texture from (0.5, 0.5) to (0,0)
-            texture.xfm_translation
-                   = { -(.5f - .5f / float(numX)), -(.5f - .5f / float(numY)) };
         } else {
-            const auto& result = LoadHioTexture2D(
-                   texture.file, inputName.GetString(), false,
-                   (outputName == HdOSPRayMaterialTokens->opacity
-                    && _type == MaterialTypes::preview));
-            texture.ospTexture = result.ospTexture;
-            texture.data = result.data;
+            // decoded in the background.  A texture loaded by a former
+            // sync is shown until then, otherwise the fallback or the
+            // material's own value.
+            if (!texture.ospTexture && hasFallback)
+                _textureFallbacks[outputName] = fallback;
+            const std::string file = texture.file;
+            const std::string channels = inputName.GetString();
+            const bool complement = isUdim
+                   ? (outputName == HdOSPRayMaterialTokens->opacity)
+                   : (outputName == HdOSPRayMaterialTokens->opacity
+                      && _type == MaterialTypes::preview);
+            std::shared_ptr<_TextureLoads> loads = _textureLoads;
+            std::shared_ptr<HdOSPRayTextureUpdates> updates
+                   = renderParam->GetTextureUpdates();
+            HdOSPRayMaterial* material = this;
+            {
+                std::lock_guard<std::mutex> lock(updates->mutex);
+                updates->loading++;
+            }
+
+            renderParam->RunBackgroundTask([=]() {
+                bool cancelled;
+                {
+                    std::lock_guard<std::mutex> lock(loads->mutex);
+                    cancelled = loads->cancelled;
+                }
+                HdOSPRayTexture result;
+                try {
+                    if (!cancelled && isUdim) {
+                        // the texture transform maps UDIM coordinates to
+                        // the tile atlas
+                        result = HdOSPRayTextureCache::GetInstance()
+                                        .GetUDIMTexture2D(file, false,
+                                                          complement);
+                    } else if (!cancelled) {
+                        result = HdOSPRayTextureCache::GetInstance()
+                                        .GetHioTexture2D(file, channels,
+                                                         false, complement);
+                    }
+                } catch (std::exception const& e) {
+                    TF_WARN("#osp: failed to load texture '%s': %s",
+                            file.c_str(), e.what());
+                }
+                {
+                    std::lock_guard<std::mutex> lock(loads->mutex);
+                    if (!loads->cancelled)
+                        loads->loaded[outputName] = result;
+                }
+
+                // the material is only touched by the render pass, if it
+                // has not been synced again or destroyed since
+                std::lock_guard<std::mutex> lock(updates->mutex);
+                updates->loading--;
+                updates->updates.push_back(
+                       [loads, material](HdOSPRayRenderParam* renderParam) {
+                           {
+                               std::lock_guard<std::mutex> lock(loads->mutex);
+                               if (loads->cancelled)
+                                   return;
+                           }
+                           material->_ApplyLoadedTextures(renderParam);
+                       });
+            });
         }
     }
 
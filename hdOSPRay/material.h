@@ -15,10 +15,16 @@
 
 #include "texture.h"
 
+#include <map>
+#include <memory>
+#include <mutex>
+
 namespace opp = ospray::cpp;
 
 PXR_NAMESPACE_USING_DIRECTIVE
 
+class HdOSPRayRenderParam;
+
 typedef std::shared_ptr<class HdStTextureResource> HdStTextureResourceSharedPtr;
 
 /// OSPRay hdMaterial
@@ -30,14 +36,16 @@ class HdOSPRayMaterial final : public HdMaterial {
 public:
     HdOSPRayMaterial(SdfPath const& id);
 
-    // TODO: free texture memory
-    virtual ~HdOSPRayMaterial() = default;
+    virtual ~HdOSPRayMaterial();
 
     /// Synchronizes state from the delegate to this object.
     virtual void Sync(HdSceneDelegate* sceneDelegate,
                       HdRenderParam* renderParam,
                       HdDirtyBits* dirtyBits) override;
 
+    /// Reverts the renderer material list entry to the default material.
+    virtual void Finalize(HdRenderParam* renderParam) override;
+
     /// Returns the minimal set of dirty bits to place in the
     /// change tracker for use in the first sync of this prim.
     /// Typically this would be all dirty bits.
@@ -121,9 +129,15 @@ protected:
     void _ProcessOspLuminousNode(HdMaterialNode node);
     void _ProcessOspThinGlassNode(HdMaterialNode node);
     void _ProcessOspGlassNode(HdMaterialNode node);
-    // parse texture node params and set them to appropriate map_ texture var
+    // parse texture node params and set them to appropriate map_ texture
+    // var.  Textures are decoded in the background and applied once loaded.
     void _ProcessTextureNode(HdMaterialNode node, const TfToken& inputName,
-                             const TfToken& outputName);
+                             const TfToken& outputName,
+                             HdOSPRayRenderParam* renderParam);
+    // apply textures decoded in the background and update the material
+    void _ApplyLoadedTextures(HdOSPRayRenderParam* renderParam);
+    // drop textures still decoding for a former sync
+    void _CancelTextureLoads();
     // parse texture transformation node params and set rotation, translation,
     // and scale
     void _ProcessTransform2dNode(HdMaterialNode node, TfToken textureName);
@@ -186,4 +200,14 @@ protected:
 
     std::map<TfToken, HdOSPRayTexture> _textures;
     opp::Material _ospMaterial;
+
+    // textures decoded in the background, replaced on every sync
+    struct _TextureLoads {
+        std::mutex mutex;
+        bool cancelled { false };
+        std::map<TfToken, HdOSPRayTexture> loaded;
+    };
+    std::shared_ptr<_TextureLoads> _textureLoads;
+    // authored fallbacks of textures that have not been loaded yet
+    std::map<TfToken, GfVec4f> _textureFallbacks;
 };
\ No newline at end of file
@@ -2,18 +2,24 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include "mesh.h"
+#include "compactAttributes.h"
 #include "config.h"
 #include "context.h"
+#include "faceVarying.h"
 #include "instancer.h"
 #include "material.h"
+#include "meshDecimation.h"
 #include "renderParam.h"
 #include "renderPass.h"
 
+#include <pxr/base/gf/bbox3d.h>
 #include <pxr/base/gf/matrix4d.h>
 #include <pxr/imaging/pxOsd/tokens.h>
 
 #include <rkcommon/math/AffineSpace.h>
 
+#include <algorithm>
+
 using namespace rkcommon::math;
 
 // clang-format off
@@ -31,7 +37,6 @@ HdOSPRayMesh::HdOSPRayMesh(SdfPath const& id, SdfPath const& instancerId)
 #endif
     , _ospMesh(nullptr)
     , _geometricModel(nullptr)
-    , _adjacencyValid(false)
     , _normalsValid(false)
     , _refined(false)
     , _cullStyle(HdCullStyleDontCare)
@@ -40,6 +45,7 @@ HdOSPRayMesh::HdOSPRayMesh(SdfPath const& id, SdfPath const& instancerId)
 
 HdOSPRayMesh::~HdOSPRayMesh()
 {
+    _CancelProxy();
     delete _geometricModel;
     delete _meshUtil;
 }
@@ -47,6 +53,14 @@ HdOSPRayMesh::~HdOSPRayMesh()
 void
 HdOSPRayMesh::Finalize(HdRenderParam* renderParam)
 {
+    HdOSPRayRenderParam* ospRenderParam
+           = static_cast<HdOSPRayRenderParam*>(renderParam);
+    if (_populated) {
+        ospRenderParam->RemoveHdOSPRayMesh(this);
+        _populated = false;
+    }
+    _CancelProxy();
+    ospRenderParam->ClearSubdivisionLevel(GetId());
 }
 
 HdDirtyBits
@@ -60,7 +74,7 @@ HdOSPRayMesh::GetInitialDirtyBitsMask() const
            | HdChangeTracker::DirtySubdivTags | HdChangeTracker::DirtyPrimvar
            | HdChangeTracker::DirtyNormals | HdChangeTracker::DirtyInstancer
            | HdChangeTracker::DirtyPrimID | HdChangeTracker::DirtyRepr
-           | HdChangeTracker::DirtyMaterialId;
+           | HdChangeTracker::DirtyMaterialId | HdChangeTracker::DirtyRenderTag;
 
     return (HdDirtyBits)mask;
 }
@@ -90,11 +104,35 @@ _IsEnabledForceQuadrangulate()
     return enabled;
 }
 
+static bool
+_IsVertexRate(HdInterpolation interpolation)
+{
+    return interpolation == HdInterpolationVertex
+           || interpolation == HdInterpolationVarying;
+}
+
+// Hand an attribute array to OSPRay.  Copied arrays are owned by OSPRay, so
+// the host array can be released after the commit.
+template <class T>
+static void
+_SetAttributeParam(opp::Geometry& geometry, const char* param,
+                   VtArray<T> const& values, OSPDataType type, bool copy)
+{
+    if (copy) {
+        geometry.setParam(param,
+                          opp::CopiedData(values.cdata(), type, values.size()));
+    } else {
+        opp::SharedData data(values.cdata(), type, values.size());
+        data.commit();
+        geometry.setParam(param, data);
+    }
+}
+
 bool
 HdOSPRayMesh::_UseQuadIndices(const HdRenderIndex& renderIndex,
-                              HdMeshTopology const& topology) const
+                              HdOSPRayTopologyEntry const& topologyEntry) const
 {
-    if (topology.GetScheme() == PxOsdOpenSubdivTokens->loop)
+    if (topologyEntry.GetTopology().GetScheme() == PxOsdOpenSubdivTokens->loop)
         return false;
 
     const HdOSPRayMaterial* material = static_cast<const HdOSPRayMaterial*>(
@@ -102,7 +140,24 @@ HdOSPRayMesh::_UseQuadIndices(const HdRenderIndex& renderIndex,
     if (material && material->HasPtex())
         return true;
 
-    return _IsEnabledForceQuadrangulate();
+    if (_IsEnabledForceQuadrangulate())
+        return true;
+
+    // batches only hold triangles, meshes small enough to be batched stay
+    // triangulated
+    const HdOSPRayConfig& config = HdOSPRayConfig::GetInstance();
+    if (config.meshBatching && GetInstancerId().IsEmpty()) {
+        size_t numTriangles = 0;
+        for (int count : topologyEntry.GetTopology().GetFaceVertexCounts())
+            numTriangles += std::max(0, count - 2);
+        if (numTriangles
+            <= size_t(std::max(0, config.meshBatchingMaxPrimitives)))
+            return false;
+    }
+
+    // quad-dominant meshes need about half the primitives as quads
+    const float threshold = config.quadMeshThreshold;
+    return threshold > 0.f && topologyEntry.GetQuadFaceRatio() >= threshold;
 }
 
 void
@@ -128,6 +183,16 @@ HdOSPRayMesh::Sync(HdSceneDelegate* sceneDelegate, HdRenderParam* renderParam,
 #endif
     }
 
+    // the render pass filters instances by render tag
+    if (*dirtyBits & HdChangeTracker::DirtyRenderTag) {
+        _syncedRenderTag = sceneDelegate->GetRenderTag(GetId());
+        *dirtyBits &= ~HdChangeTracker::DirtyRenderTag;
+        // edits after the initial sync split the mesh out of any batch
+        if (_populated)
+            _editVersion++;
+        ospRenderParam->UpdateModelVersion();
+    }
+
     // Create ospray mesh
     _PopulateOSPMesh(sceneDelegate, std::move(renderer), dirtyBits, desc,
                      ospRenderParam);
@@ -163,12 +228,14 @@ HdOSPRayMesh::_UpdatePrimvarSources(HdSceneDelegate* sceneDelegate,
                                                    HdOSPRayTokens->st)) {
                 if (value.IsHolding<VtVec2fArray>()) {
                     _texcoords = value.Get<VtVec2fArray>();
+                    _compactTexcoords.Clear();
                     _texcoordsPrimVarName = pv.name;
                     _texcoordsInterpolation = interp;
                 }
             } else if (pv.name == HdTokens->normals) {
                 if (value.IsHolding<VtVec3fArray>()) {
                     _normals = value.Get<VtVec3fArray>();
+                    _compactNormals.Clear();
                     _normalsPrimVarName = pv.name;
                     _normalsInterpolation = interp;
                 }
@@ -179,6 +246,7 @@ HdOSPRayMesh::_UpdatePrimvarSources(HdSceneDelegate* sceneDelegate,
                 if (value.IsHolding<VtVec3fArray>()) {
                     _colorsPrimVarName = pv.name;
                     _colors = value.Get<VtVec3fArray>();
+                    _compactColors.Clear();
                 }
             }
             // TODO: check display opacity
@@ -198,9 +266,55 @@ HdOSPRayMesh::_PopulateOSPMesh(HdSceneDelegate* sceneDelegate,
     SdfPath const& id = GetId();
     bool isTransformDirty = false;
 
+    if (HdChangeTracker::IsVisibilityDirty(*dirtyBits, id)) {
+        const bool wasVisible = IsVisible();
+        _UpdateVisibility(sceneDelegate, dirtyBits);
+        if (wasVisible && !IsVisible())
+            _hiddenSince = std::chrono::steady_clock::now();
+        renderParam->UpdateModelVersion();
+    }
+
+    // hidden prims keep their dirty bits and are built once they become
+    // visible.  Prims hidden for long release their OSPRay objects.
+    if (!IsVisible()) {
+        *dirtyBits &= ~HdChangeTracker::DirtyVisibility;
+        const int releaseSeconds
+               = HdOSPRayConfig::GetInstance().releaseHiddenSeconds;
+        if (_populated && releaseSeconds > 0
+            && IsHiddenLongerThan(releaseSeconds))
+            _ReleaseHidden(renderParam, dirtyBits);
+        return;
+    }
+
+    // edits after the initial sync split the mesh out of any batch.  Hidden
+    // meshes keep their dirty bits, edits count once they are applied.
+    const HdDirtyBits editBits = HdChangeTracker::DirtyPoints
+           | HdChangeTracker::DirtyTopology | HdChangeTracker::DirtyTransform
+           | HdChangeTracker::DirtyPrimvar | HdChangeTracker::DirtyNormals
+           | HdChangeTracker::DirtyDisplayStyle
+           | HdChangeTracker::DirtySubdivTags | HdChangeTracker::DirtyInstancer
+           | HdChangeTracker::DirtyMaterialId;
+    if (_populated && (*dirtyBits & editBits))
+        _editVersion++;
+
+    // sources released in lean memory mode are pulled again for any change
+    // that rebuilds the geometry
+    const HdDirtyBits rebuildBits = HdChangeTracker::DirtyPoints
+           | HdChangeTracker::DirtyTopology | HdChangeTracker::DirtyPrimvar
+           | HdChangeTracker::DirtyNormals | HdChangeTracker::DirtyDisplayStyle
+           | HdChangeTracker::DirtySubdivTags | HdChangeTracker::DirtyRepr;
+    if (_sourcesReleased && (*dirtyBits & rebuildBits)) {
+        *dirtyBits |= HdChangeTracker::DirtyPoints
+               | HdChangeTracker::DirtyNormals | HdChangeTracker::DirtyPrimvar;
+        _sourcesReleased = false;
+    }
+
     if (HdChangeTracker::IsPrimvarDirty(*dirtyBits, id, HdTokens->points)) {
         VtValue value = sceneDelegate->Get(id, HdTokens->points);
         _points = value.Get<VtVec3fArray>();
+        _bounds = GfRange3f();
+        for (const GfVec3f& p : _points)
+            _bounds.UnionWith(p);
         if (_points.size() > 0) {
             _normalsValid = false;
         }
@@ -216,11 +330,6 @@ HdOSPRayMesh::_PopulateOSPMesh(HdSceneDelegate* sceneDelegate,
         isTransformDirty = true;
     }
 
-    if (HdChangeTracker::IsVisibilityDirty(*dirtyBits, id)) {
-        _UpdateVisibility(sceneDelegate, dirtyBits);
-        renderParam->UpdateModelVersion();
-    }
-
     if (HdChangeTracker::IsCullStyleDirty(*dirtyBits, id)) {
         _cullStyle = GetCullStyle(sceneDelegate);
     }
@@ -260,18 +369,23 @@ HdOSPRayMesh::_PopulateOSPMesh(HdSceneDelegate* sceneDelegate,
     _meshUtil = new HdMeshUtil(&_topology, GetId());
 
     const HdRenderIndex& renderIndex = sceneDelegate->GetRenderIndex();
-    bool useQuads = _UseQuadIndices(renderIndex, _topology);
 
     if (HdChangeTracker::IsSubdivTagsDirty(*dirtyBits, id)
         && _topology.GetRefineLevel() > 0) {
         _topology.SetSubdivTags(sceneDelegate->GetSubdivTags(id));
     }
 
+    const int previousTessellationRate = _tessellationRate;
     if (HdChangeTracker::IsDisplayStyleDirty(*dirtyBits, id)) {
         if (doRefine) { // set subdiv rate
-            _tessellationRate = (1 << _topology.GetRefineLevel());
-            if (_tessellationRate == 1) {
-                _tessellationRate++;
+            _tessellationRate = GetMaxTessellationRate();
+            // adaptive subdivision lowers the rate of distant prims.  Start
+            // coarse until the render pass has picked a rate.
+            if (HdOSPRayConfig::GetInstance().adaptiveSubdivision
+                && GetInstancerId().IsEmpty()) {
+                const int rate = renderParam->GetSubdivisionLevel(id);
+                _tessellationRate = std::min(
+                       _tessellationRate, rate > 0 ? rate : MinTessellationRate);
             }
         }
     }
@@ -288,25 +402,36 @@ HdOSPRayMesh::_PopulateOSPMesh(HdSceneDelegate* sceneDelegate,
         int refineLevel = _topology.GetRefineLevel();
         _topology = HdMeshTopology(GetMeshTopology(sceneDelegate), refineLevel);
         _topology.SetSubdivTags(subdivTags);
-        _adjacencyValid = false;
 
         if (doRefine && !_points.empty()) {
             _ospMesh = _CreateOSPRaySubdivMesh();
         }
         _refined = doRefine;
+    } else if (doRefine && _tessellationRate != previousTessellationRate
+               && !_points.empty()) {
+        // retessellate at the new rate
+        newMesh = true;
+        _ospMesh = _CreateOSPRaySubdivMesh();
     }
 
-    _normalsValid = false;
-    if (_smoothNormals && !_adjacencyValid) {
-        _adjacency.BuildAdjacencyTable(&_topology);
-        _adjacencyValid = true;
-        // If we rebuilt the adjacency table, force a rebuild of normals.
-        _normalsValid = false;
+    // index buffers and adjacency are shared between meshes of identical
+    // topology.  The entry's topology shares our VtArrays, so the comparison
+    // is usually an identity check.
+    if (!_topologyEntry || _topologyEntry->GetTopology() != _topology) {
+        _topologyEntry
+               = renderParam->GetTopologyRegistry().GetEntry(_topology);
     }
+
+    bool useQuads = _UseQuadIndices(renderIndex, *_topologyEntry);
+    _useQuads = useQuads;
+
+    _normalsValid = false;
     // calculate new smooth normals
-    if (_normals.empty() && _smoothNormals && !_normalsValid && !doRefine) {
+    if (_normals.empty() && _compactNormals.IsEmpty() && !_sourcesReleased
+        && _smoothNormals && !_normalsValid && !doRefine) {
         _normals = Hd_SmoothNormals::ComputeSmoothNormals(
-               &_adjacency, _points.size(), _points.cdata());
+               &_topologyEntry->GetAdjacency(), _points.size(),
+               _points.cdata());
         _normalsValid = true;
     }
 
@@ -316,126 +441,180 @@ HdOSPRayMesh::_PopulateOSPMesh(HdSceneDelegate* sceneDelegate,
                                            HdOSPRayTokens->st)) {
         newMesh = true;
 
+        _RestoreCompactAttributes();
+
+        // arrays and interpolation modes handed to OSPRay.  Face-varying
+        // primvars may be demoted to vertex interpolation below.
+        VtVec3fArray normals = _normals;
+        VtVec3fArray colors = _colors;
+        VtVec2fArray texcoords = _texcoords;
+        HdInterpolation normalsInterpolation = _normalsInterpolation;
+        HdInterpolation colorsInterpolation = _colorsInterpolation;
+        HdInterpolation texcoordsInterpolation = _texcoordsInterpolation;
+
         if (!_refined) {
+            _renderPoints = _points;
+            _splitTopologyEntry.reset();
+            if (HdOSPRayConfig::GetInstance().demoteFaceVarying) {
+                _DemoteFaceVaryingPrimvars(renderParam, normals,
+                                           normalsInterpolation, colors,
+                                           colorsInterpolation, texcoords,
+                                           texcoordsInterpolation);
+            }
+            // vertices split by the demotion are indexed by a topology of
+            // their own
+            const HdOSPRayTopologyEntry& indexEntry = _splitTopologyEntry
+                   ? *_splitTopologyEntry
+                   : *_topologyEntry;
+
+            // shallow copies of the shared, read-only buffers
             if (useQuads) {
-                _meshUtil->ComputeQuadIndices(&_quadIndices,
-                                              &_quadPrimitiveParams);
+                _quadIndices = indexEntry.GetQuadIndices();
+                _quadPrimitiveParams = indexEntry.GetQuadPrimitiveParams();
+                _triangulatedIndices = VtVec3iArray();
+                _trianglePrimitiveParams = VtIntArray();
             } else {
-                _meshUtil->ComputeTriangleIndices(&_triangulatedIndices,
-                                                  &_trianglePrimitiveParams);
+                _triangulatedIndices = indexEntry.GetTriangleIndices();
+                _trianglePrimitiveParams
+                       = indexEntry.GetTrianglePrimitiveParams();
+                _quadIndices = HdOSPRayQuadIndexArray();
+                _quadPrimitiveParams = HdOSPRayQuadPrimitiveParamArray();
             }
 
             if ((_quadIndices.empty() && _triangulatedIndices.empty())
-                || _points.empty())
+                || _renderPoints.empty())
                 return;
 
-            if (!_colors.empty()) {
+            if (!colors.empty()) {
                 _ComputePrimvars<VtVec3fArray>(
-                       *_meshUtil, useQuads, _colors, _computedColors,
-                       _colorsPrimVarName, _colorsInterpolation);
+                       *_meshUtil, useQuads, colors, _computedColors,
+                       _colorsPrimVarName, colorsInterpolation);
             }
-            if (!_normals.empty()) {
+            if (!normals.empty()) {
                 _ComputePrimvars<VtVec3fArray>(
-                       *_meshUtil, useQuads, _normals, _computedNormals,
-                       _normalsPrimVarName, _normalsInterpolation);
+                       *_meshUtil, useQuads, normals, _computedNormals,
+                       _normalsPrimVarName, normalsInterpolation);
             }
-            if (!_texcoords.empty()) {
+            if (!texcoords.empty()) {
                 _ComputePrimvars<VtVec2fArray>(
-                       *_meshUtil, useQuads, _texcoords, _computedTexcoords,
-                       _texcoordsPrimVarName, _texcoordsInterpolation);
+                       *_meshUtil, useQuads, texcoords, _computedTexcoords,
+                       _texcoordsPrimVarName, texcoordsInterpolation);
             }
 
-            _ospMesh = _CreateOSPRayMesh(_computedTexcoords, _points,
+            _ospMesh = _CreateOSPRayMesh(_computedTexcoords, _renderPoints,
                                          _computedNormals, _computedColors,
                                          _refined, useQuads);
+        } else {
+            _renderPoints = VtVec3fArray();
+            _splitTopologyEntry.reset();
         }
-
-        if (!_normals.empty()) {
-            VtVec3fArray& normals = _normals;
-            if (!_computedNormals.empty())
-                normals = _computedNormals;
-            opp::SharedData normalsData = opp::SharedData(
-                   normals.cdata(), OSP_VEC3F, normals.size());
-            normalsData.commit();
-            if (_normalsInterpolation == HdInterpolationFaceVarying) {
-                _ospMesh.setParam("normal", normalsData);
-            } else if ((_normalsInterpolation == HdInterpolationVarying)
-                       || (_normalsInterpolation == HdInterpolationVertex)) {
-                _ospMesh.setParam("vertex.normal", normalsData);
+        const HdOSPRayTopologyEntrySharedPtr& indexEntry
+               = _splitTopologyEntry ? _splitTopologyEntry : _topologyEntry;
+
+        // with compact attributes the host keeps reduced precision copies of
+        // the authored values and OSPRay gets its own float arrays, unless
+        // it reads the authored array in place anyway
+        const bool compactAttributes
+               = HdOSPRayConfig::GetInstance().compactAttributes;
+        const bool sharesHostArrays = HdOSPRayDeviceSharesHostArrays();
+        bool compactNormals = false;
+        bool compactColors = false;
+        bool compactTexcoords = false;
+        // host buffers OSPRay reads in place, these have to stay alive
+        std::vector<const void*> sharedBuffers;
+        sharedBuffers.push_back(_refined ? _points.cdata()
+                                         : _renderPoints.cdata());
+
+        if (!normals.empty()) {
+            const VtVec3fArray& ospNormals
+                   = _computedNormals.empty() ? normals : _computedNormals;
+            compactNormals = compactAttributes && _normals.size() > 1
+                   && !(sharesHostArrays
+                        && ospNormals.cdata() == _normals.cdata());
+            const char* param = nullptr;
+            if (normalsInterpolation == HdInterpolationFaceVarying) {
+                param = "normal";
+            } else if ((normalsInterpolation == HdInterpolationVarying)
+                       || (normalsInterpolation == HdInterpolationVertex)) {
+                param = "vertex.normal";
             } else {
                 TF_DEBUG_MSG(OSP,
                              "osp::mesh unsupported normal interpolation mode");
             }
+            if (param) {
+                _SetAttributeParam(_ospMesh, param, ospNormals, OSP_VEC3F,
+                                   compactNormals);
+                if (!compactNormals)
+                    sharedBuffers.push_back(ospNormals.cdata());
+            }
         }
 
-        if (!_colors.empty()) {
+        if (!colors.empty()) {
             // TODO: add back in opacities
-            VtVec3fArray& colors = _colors;
-            if (!_computedColors.empty())
-                colors = _computedColors;
-            opp::SharedData colorsData
-                   = opp::SharedData(colors.cdata(), OSP_VEC3F, colors.size());
-            colorsData.commit();
-            if (_colorsInterpolation == HdInterpolationFaceVarying)
-                _ospMesh.setParam("color", colorsData);
-            else if ((_colorsInterpolation == HdInterpolationVarying)
-                     || (_colorsInterpolation == HdInterpolationVertex))
-                _ospMesh.setParam("vertex.color", colorsData);
+            const VtVec3fArray& ospColors
+                   = _computedColors.empty() ? colors : _computedColors;
+            compactColors = compactAttributes && _colors.size() > 1
+                   && !(sharesHostArrays
+                        && ospColors.cdata() == _colors.cdata());
+            const char* param = nullptr;
+            if (colorsInterpolation == HdInterpolationFaceVarying)
+                param = "color";
+            else if ((colorsInterpolation == HdInterpolationVarying)
+                     || (colorsInterpolation == HdInterpolationVertex))
+                param = "vertex.color";
+            if (param) {
+                _SetAttributeParam(_ospMesh, param, ospColors, OSP_VEC3F,
+                                   compactColors);
+                if (!compactColors)
+                    sharedBuffers.push_back(ospColors.cdata());
+            }
         }
 
-        if (_texcoords.size() > 1) {
-            VtVec2fArray& texcoords = _texcoords;
-            if (!_computedTexcoords.empty())
-                texcoords = _computedTexcoords;
-            opp::SharedData texcoordsData = opp::SharedData(
-                   texcoords.cdata(), OSP_VEC2F, texcoords.size());
-            texcoordsData.commit();
-            if (_texcoordsInterpolation == HdInterpolationFaceVarying)
-                _ospMesh.setParam("texcoord", texcoordsData);
-            else if (_texcoordsInterpolation == HdInterpolationVertex
-                     || _texcoordsInterpolation == HdInterpolationVarying) {
-                _ospMesh.setParam("vertex.texcoord", texcoordsData);
+        if (texcoords.size() > 1) {
+            const VtVec2fArray& ospTexcoords = _computedTexcoords.empty()
+                   ? texcoords
+                   : _computedTexcoords;
+            compactTexcoords = compactAttributes
+                   && !(sharesHostArrays
+                        && ospTexcoords.cdata() == _texcoords.cdata());
+            const char* param = nullptr;
+            if (texcoordsInterpolation == HdInterpolationFaceVarying)
+                param = "texcoord";
+            else if (texcoordsInterpolation == HdInterpolationVertex
+                     || texcoordsInterpolation == HdInterpolationVarying) {
+                param = "vertex.texcoord";
             } else {
                 TF_DEBUG_MSG(OSP, "unsupported texcoord interpolation mode");
             }
+            if (param) {
+                _SetAttributeParam(_ospMesh, param, ospTexcoords, OSP_VEC2F,
+                                   compactTexcoords);
+                if (!compactTexcoords)
+                    sharedBuffers.push_back(ospTexcoords.cdata());
+            }
         }
 
         _ospMesh.commit();
 
-        const HdOSPRayMaterial* subsetMaterial = nullptr;
-
-        for (const auto& subset : _topology.GetGeomSubsets()) {
-            if (!TF_VERIFY(subset.type == HdGeomSubset::TypeFaceSet))
-                continue;
-
-            const HdOSPRayMaterial* material
-                   = static_cast<const HdOSPRayMaterial*>(renderIndex.GetSprim(
-                          HdPrimTypeTokens->material, subset.materialId));
-            subsetMaterial = material;
-        }
-
-        const HdOSPRayMaterial* material = nullptr;
-        if (subsetMaterial)
-            material = subsetMaterial;
+        // materials are indices into the renderer material list.  GeomSubsets
+        // resolve to one index per primitive on a single geometric model.
+        _materialIndex
+               = _GetMaterialIndex(renderIndex, GetMaterialId(), renderParam);
+        std::vector<uint32_t>& materialIndices = _materialIndices;
+        materialIndices.clear();
+        if (_topology.GetGeomSubsets().empty())
+            materialIndices.push_back(_materialIndex);
         else
-            material
-                   = static_cast<const HdOSPRayMaterial*>(renderIndex.GetSprim(
-                          HdPrimTypeTokens->material, GetMaterialId()));
-
-        opp::Material ospMaterial = nullptr;
-
-        if (material && material->GetOSPRayMaterial()) {
-            ospMaterial = material->GetOSPRayMaterial();
-        } else {
-            ospMaterial = HdOSPRayMaterial::CreateDefaultMaterial(_singleColor);
-        }
+            materialIndices = _ComputePrimitiveMaterialIndices(renderIndex,
+                                                               renderParam);
 
         // Create OSPRay Mesh
         if (_geometricModel)
             delete _geometricModel;
         _geometricModel = new opp::GeometricModel(_ospMesh);
 
-        _geometricModel->setParam("material", ospMaterial);
+        _geometricModel->setParam("material",
+                                  opp::CopiedData(materialIndices));
         _geometricModel->setParam("id", (unsigned int)GetPrimId());
         _ospMesh.commit();
         if (_colorsInterpolation == HdInterpolationUniform
@@ -456,6 +635,15 @@ HdOSPRayMesh::_PopulateOSPMesh(HdSceneDelegate* sceneDelegate,
 
         _geometricModel->commit();
 
+        _UpdateProxy(renderParam, indexEntry);
+
+        if (compactNormals || compactColors || compactTexcoords) {
+            _CompactAttributes(compactNormals, compactColors,
+                               compactTexcoords);
+        }
+        if (HdOSPRayConfig::GetInstance().leanMemory)
+            _ReleaseSources(sharedBuffers);
+
         renderParam->UpdateModelVersion();
     }
 
@@ -466,44 +654,96 @@ HdOSPRayMesh::_PopulateOSPMesh(HdSceneDelegate* sceneDelegate,
                                           GetInstancerId());
 #endif
 
-    if (HdChangeTracker::IsInstancerDirty(*dirtyBits, id) || isTransformDirty) {
+    // a new geometric model has to be added to new instances
+    if (HdChangeTracker::IsInstancerDirty(*dirtyBits, id) || isTransformDirty
+        || newMesh) {
+        bool instancesAdded = true;
         if (!GetInstancerId().IsEmpty()) {
-            // TODO: reuse instances for instancer?
-            _ospInstances.clear();
             HdRenderIndex& renderIndex = sceneDelegate->GetRenderIndex();
-            HdInstancer* instancer = renderIndex.GetInstancer(GetInstancerId());
-            VtMatrix4dArray transforms
-                   = static_cast<HdOSPRayInstancer*>(instancer)
-                            ->ComputeInstanceTransforms(GetId());
+            HdOSPRayInstancer* instancer = static_cast<HdOSPRayInstancer*>(
+                   renderIndex.GetInstancer(GetInstancerId()));
+            std::vector<affine3f> transforms
+                   = instancer->ComputeInstanceTransforms(GetId());
+            std::vector<vec4f> instanceColors
+                   = instancer->ComputeInstanceColors(GetId());
+            std::vector<unsigned int> instanceIds
+                   = instancer->ComputeInstanceIds(GetId());
+            std::vector<unsigned char> instanceMask
+                   = instancer->ComputeInstanceMask(GetId());
+            if (instanceColors.size() != transforms.size())
+                instanceColors.clear();
+            if (instanceIds.size() != transforms.size())
+                instanceIds.clear();
+            if (instanceMask.size() != transforms.size())
+                instanceMask.clear();
+            const bool instancePrimvars
+                   = !instanceColors.empty() || !instanceIds.empty();
 
             size_t newSize = transforms.size();
+            float* xfmf = _transform.GetArray();
+            const affine3f prototypeXfm(vec3f(xfmf[0], xfmf[1], xfmf[2]),
+                                        vec3f(xfmf[4], xfmf[5], xfmf[6]),
+                                        vec3f(xfmf[8], xfmf[9], xfmf[10]),
+                                        vec3f(xfmf[12], xfmf[13], xfmf[14]));
+
+            // instances of an unchanged model are updated where their
+            // transform changed.  Instance primvars rebuild all instances.
+            if (newMesh || !_instanceGroup || instancePrimvars
+                || _instancePrimvars) {
+                _instanceGroup = opp::Group();
+                if (_geometricModel)
+                    _instanceGroup.setParam("geometry",
+                                            opp::CopiedData(*_geometricModel));
+                _instanceGroup.commit();
+                _ospInstances.clear();
+                _instanceTransforms.clear();
+                _instanceMask.clear();
+            }
 
-            opp::Group group;
-            if (_geometricModel)
-                group.setParam("geometry", opp::CopiedData(*_geometricModel));
-            group.commit();
-
-            _ospInstances.reserve(newSize);
-            for (size_t i = 0; i < newSize; i++) {
-                opp::Instance instance(group);
-
-                GfMatrix4f matf = _transform * GfMatrix4f(transforms[i]);
-                float* xfmf = matf.GetArray();
-                affine3f xfm(vec3f(xfmf[0], xfmf[1], xfmf[2]),
-                             vec3f(xfmf[4], xfmf[5], xfmf[6]),
-                             vec3f(xfmf[8], xfmf[9], xfmf[10]),
-                             vec3f(xfmf[12], xfmf[13], xfmf[14]));
-                instance.setParam("transform", xfm);
-                instance.setParam("id", (unsigned int)i);
-                instance.commit();
-                _ospInstances.push_back(instance);
+            // toggled visibility only changes which instances are collected
+            std::vector<affine3f> previousTransforms;
+            previousTransforms.swap(_instanceTransforms);
+            std::vector<unsigned char> previousMask;
+            previousMask.swap(_instanceMask);
+            _instanceMask = std::move(instanceMask);
+            _instanceTransforms.resize(newSize);
+            for (size_t i = 0; i < newSize; i++)
+                _instanceTransforms[i] = transforms[i] * prototypeXfm;
+            if (!instanceColors.empty() && _geometricModel) {
+                // colored instances share the geometry, not the model
+                auto createModel = [this]() {
+                    opp::GeometricModel model(_ospMesh);
+                    model.setParam("material",
+                                   opp::CopiedData(_materialIndices));
+                    model.setParam("id", (unsigned int)GetPrimId());
+                    return model;
+                };
+                HdOSPRayCreateColoredInstances(createModel,
+                                               _instanceTransforms,
+                                               instanceColors, instanceIds,
+                                               _ospInstances, _instanceMask);
+            } else if (!instanceIds.empty()) {
+                HdOSPRayCreateInstances(_instanceGroup, _instanceTransforms,
+                                        _ospInstances, instanceIds,
+                                        _instanceMask);
+            } else {
+                instancesAdded = HdOSPRayUpdateInstances(
+                       _instanceGroup, previousTransforms,
+                       _instanceTransforms, _ospInstances, previousMask,
+                       _instanceMask);
             }
+            _instancePrimvars = instancePrimvars;
         } else {
-            if (newMesh)
+            // instances of a former instancer are replaced
+            const bool newInstance = newMesh || _instanceGroup
+                   || _ospInstances.empty();
+            _instanceGroup = nullptr;
+            _instanceMask.clear();
+            if (newInstance)
                 _ospInstances.clear();
             opp::Group group;
             opp::Instance instance;
-            if (newMesh)
+            if (newInstance)
                 instance = opp::Instance(group);
             else
                 instance = _ospInstances.back();
@@ -516,21 +756,27 @@ HdOSPRayMesh::_PopulateOSPMesh(HdSceneDelegate* sceneDelegate,
             instance.setParam("transform", xfm);
             instance.setParam("id", (unsigned int)0);
             instance.commit();
+            _instanceTransforms.assign(1, xfm);
 
-            if (newMesh) {
-                if (_geomSubsetModels.size()) {
+            if (newInstance) {
+                if (_geometricModel)
                     group.setParam("geometry",
-                                   opp::CopiedData(_geomSubsetModels));
-                } else {
-                    if (_geometricModel)
-                        group.setParam("geometry",
-                                       opp::CopiedData(*_geometricModel));
-                }
+                                   opp::CopiedData(*_geometricModel));
                 group.commit();
                 _ospInstances.push_back(instance);
             }
+            // a batched mesh is split out of its batch by the next model
+            // update
+            instancesAdded = newInstance
+                   || renderParam->GetMeshBatcher().IsBatched(this);
         }
-        renderParam->UpdateModelVersion();
+        _instancesVersion++;
+        // moved instances keep the world instance list, the world only has
+        // to be recommitted
+        if (instancesAdded)
+            renderParam->UpdateModelVersion();
+        else
+            renderParam->UpdateInstanceVersion();
     }
     if (!_populated) {
         renderParam->AddHdOSPRayMesh(this);
@@ -540,13 +786,495 @@ HdOSPRayMesh::_PopulateOSPMesh(HdSceneDelegate* sceneDelegate,
     *dirtyBits &= ~HdChangeTracker::AllSceneDirtyBits;
 }
 
+bool
+HdOSPRayMesh::AddOSPInstances(std::vector<opp::Instance>& instanceList,
+                              bool useProxy) const
+{
+    if (!IsVisible())
+        return false;
+    if (useProxy && _proxy) {
+        std::lock_guard<std::mutex> lock(_proxy->mutex);
+        if (_proxy->group) {
+            // proxy instances follow the transforms of the full mesh
+            if (_proxy->instancesVersion != _instancesVersion) {
+                _proxy->instances.clear();
+                HdOSPRayCreateInstances(_proxy->group, _instanceTransforms,
+                                        _proxy->instances, {}, _instanceMask);
+                _proxy->instancesVersion = _instancesVersion;
+            }
+            HdOSPRayAppendVisibleInstances(_proxy->instances, _instanceMask,
+                                           instanceList);
+            return true;
+        }
+    }
+    // split out of its batch, or no longer batchable
+    if (_ospInstances.empty() && GetInstancerId().IsEmpty() && _geometricModel
+        && _instanceTransforms.size() == 1) {
+        opp::Group group;
+        group.setParam("geometry", opp::CopiedData(*_geometricModel));
+        group.commit();
+        opp::Instance instance(group);
+        instance.setParam("transform", _instanceTransforms[0]);
+        instance.setParam("id", (unsigned int)0);
+        instance.commit();
+        _ospInstances.push_back(instance);
+    }
+    HdOSPRayAppendVisibleInstances(_ospInstances, _instanceMask,
+                                   instanceList);
+    return false;
+}
+
 void
-HdOSPRayMesh::AddOSPInstances(std::vector<opp::Instance>& instanceList) const
+HdOSPRayMesh::_UpdateProxy(HdOSPRayRenderParam* renderParam,
+                           HdOSPRayTopologyEntrySharedPtr const& indexEntry)
+{
+    _CancelProxy();
+
+    const HdOSPRayConfig& config = HdOSPRayConfig::GetInstance();
+    const size_t numPrimitives = _useQuads ? _quadPrimitiveParams.size()
+                                           : _trianglePrimitiveParams.size();
+    if (!config.interactiveProxies || _refined || !indexEntry
+        || numPrimitives < size_t(config.proxyMinPrimitives))
+        return;
+
+    // the task decimates the triangulation, which quad meshes compute in a
+    // buffer of their own.  Triangulating through the shared topology entry
+    // would keep a second index buffer alive for as long as the entry.
+    const size_t numTriangles = _useQuads ? 2 * numPrimitives : numPrimitives;
+    const size_t targetTriangles = numTriangles / config.proxyReduction;
+    std::shared_ptr<_ProxyState> proxy = std::make_shared<_ProxyState>();
+    HdOSPRayTopologyEntrySharedPtr entry = indexEntry;
+    const VtVec3fArray points = _renderPoints;
+    const uint32_t materialIndex = _materialIndex;
+    const unsigned int primId = GetPrimId();
+    const bool constantColor = _colorsInterpolation == HdInterpolationConstant
+           && !_colors.empty();
+    const vec4f color = constantColor
+           ? vec4f(_colors[0][0], _colors[0][1], _colors[0][2], 1.f)
+           : vec4f(1.f);
+    const SdfPath id = GetId();
+    const bool useQuads = _useQuads;
+    _proxy = proxy;
+
+    renderParam->RunBackgroundTask([=]() {
+        {
+            std::lock_guard<std::mutex> lock(proxy->mutex);
+            if (proxy->cancelled)
+                return;
+        }
+        VtVec3iArray quadTriangles;
+        if (useQuads) {
+            VtIntArray primitiveParams;
+            HdMeshUtil meshUtil(&entry->GetTopology(), id);
+            meshUtil.ComputeTriangleIndices(&quadTriangles, &primitiveParams);
+        }
+        const VtVec3iArray& triangles
+               = useQuads ? quadTriangles : entry->GetTriangleIndices();
+        VtVec3fArray decimatedPoints;
+        VtVec3iArray decimatedTriangles;
+        if (!HdOSPRayDecimateMesh(points, triangles, targetTriangles,
+                                  &decimatedPoints, &decimatedTriangles))
+            return;
+        TF_DEBUG_MSG(OSP, "osp::mesh proxy of %s: %zu of %zu triangles\n",
+                     id.GetText(), decimatedTriangles.size(), numTriangles);
+        // meshes are cancelled when they are destroyed, skip creating
+        // OSPRay objects the render delegate would wait for
+        {
+            std::lock_guard<std::mutex> lock(proxy->mutex);
+            if (proxy->cancelled)
+                return;
+        }
+
+        opp::Geometry geometry("mesh");
+        geometry.setParam("vertex.position",
+                          opp::CopiedData(decimatedPoints.cdata(), OSP_VEC3F,
+                                          decimatedPoints.size()));
+        geometry.setParam("index",
+                          opp::CopiedData(decimatedTriangles.cdata(),
+                                          OSP_VEC3UI,
+                                          decimatedTriangles.size()));
+        geometry.commit();
+
+        // GeomSubset materials are not carried over, the proxy uses the
+        // material of the mesh
+        opp::GeometricModel model(geometry);
+        model.setParam("material",
+                       opp::CopiedData(std::vector<uint32_t>(1, materialIndex)));
+        model.setParam("id", primId);
+        if (constantColor)
+            model.setParam("color", color);
+        model.commit();
+
+        opp::Group group;
+        group.setParam("geometry", opp::CopiedData(model));
+        group.commit();
+
+        std::lock_guard<std::mutex> lock(proxy->mutex);
+        if (proxy->cancelled)
+            return;
+        proxy->group = group;
+        renderParam->UpdateProxyVersion();
+    });
+}
+
+bool
+HdOSPRayMesh::IsHiddenLongerThan(double seconds) const
 {
-    if (IsVisible()) {
-        instanceList.insert(instanceList.end(), _ospInstances.begin(),
-                            _ospInstances.end());
+    if (IsVisible() || !_populated)
+        return false;
+    const std::chrono::duration<double> hidden
+           = std::chrono::steady_clock::now() - _hiddenSince;
+    return hidden.count() >= seconds;
+}
+
+void
+HdOSPRayMesh::_ReleaseHidden(HdOSPRayRenderParam* renderParam,
+                             HdDirtyBits* dirtyBits)
+{
+    TF_DEBUG_MSG(OSP, "osp::mesh releasing hidden %s\n", GetId().GetText());
+    renderParam->RemoveHdOSPRayMesh(this);
+    _populated = false;
+    _CancelProxy();
+
+    _ospInstances.clear();
+    _instanceTransforms.clear();
+    delete _geometricModel;
+    _geometricModel = nullptr;
+    _instanceGroup = nullptr;
+    _ospMesh = nullptr;
+
+    _topology = HdMeshTopology();
+    _topologyEntry.reset();
+    _splitTopologyEntry.reset();
+    _triangulatedIndices = VtVec3iArray();
+    _trianglePrimitiveParams = VtIntArray();
+    _quadIndices = HdOSPRayQuadIndexArray();
+    _quadPrimitiveParams = HdOSPRayQuadPrimitiveParamArray();
+    _points = VtVec3fArray();
+    _renderPoints = VtVec3fArray();
+    _normals = VtVec3fArray();
+    _computedNormals = VtVec3fArray();
+    _colors = VtVec3fArray();
+    _computedColors = VtVec3fArray();
+    _texcoords = VtVec2fArray();
+    _computedTexcoords = VtVec2fArray();
+    _compactNormals.Clear();
+    _compactColors.Clear();
+    _compactTexcoords.Clear();
+    _sourcesReleased = false;
+    _refined = false;
+
+    // everything is pulled from the scene again once visible
+    *dirtyBits |= HdChangeTracker::DirtyPoints | HdChangeTracker::DirtyTopology
+           | HdChangeTracker::DirtyTransform | HdChangeTracker::DirtyDisplayStyle
+           | HdChangeTracker::DirtySubdivTags | HdChangeTracker::DirtyPrimvar
+           | HdChangeTracker::DirtyNormals | HdChangeTracker::DirtyInstancer
+           | HdChangeTracker::DirtyCullStyle
+           | HdChangeTracker::DirtyDoubleSided;
+}
+
+void
+HdOSPRayMesh::_CancelProxy()
+{
+    if (!_proxy)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(_proxy->mutex);
+        _proxy->cancelled = true;
+    }
+    _proxy.reset();
+}
+
+uint32_t
+HdOSPRayMesh::_GetMaterialIndex(const HdRenderIndex& renderIndex,
+                                const SdfPath& materialId,
+                                HdOSPRayRenderParam* renderParam) const
+{
+    const HdOSPRayMaterial* material = static_cast<const HdOSPRayMaterial*>(
+           renderIndex.GetSprim(HdPrimTypeTokens->material, materialId));
+    if (material && material->GetOSPRayMaterial())
+        return renderParam->GetMaterialIndex(materialId,
+                                             material->GetOSPRayMaterial());
+    return HdOSPRayRenderParam::DefaultMaterialIndex;
+}
+
+std::vector<uint32_t>
+HdOSPRayMesh::_ComputePrimitiveMaterialIndices(
+       const HdRenderIndex& renderIndex,
+       HdOSPRayRenderParam* renderParam) const
+{
+    std::vector<uint32_t> faceMaterials(_topology.GetNumFaces(),
+                                        _materialIndex);
+    for (const auto& subset : _topology.GetGeomSubsets()) {
+        if (!TF_VERIFY(subset.type == HdGeomSubset::TypeFaceSet))
+            continue;
+        const uint32_t materialIndex
+               = _GetMaterialIndex(renderIndex, subset.materialId, renderParam);
+        for (int face : subset.indices) {
+            if (face >= 0 && size_t(face) < faceMaterials.size())
+                faceMaterials[face] = materialIndex;
+        }
+    }
+
+    // subdivision primitives are the coarse faces
+    if (_refined)
+        return faceMaterials;
+
+    std::vector<uint32_t> primMaterials;
+    if (_useQuads) {
+        primMaterials.resize(_quadPrimitiveParams.size());
+        for (size_t i = 0; i < primMaterials.size(); i++) {
+#if HD_API_VERSION < 36
+            const int coarseFaceParam = _quadPrimitiveParams[i][0];
+#else
+            const int coarseFaceParam = _quadPrimitiveParams[i];
+#endif
+            primMaterials[i] = faceMaterials
+                   [HdMeshUtil::DecodeFaceIndexFromCoarseFaceParam(
+                          coarseFaceParam)];
+        }
+    } else {
+        primMaterials.resize(_trianglePrimitiveParams.size());
+        for (size_t i = 0; i < primMaterials.size(); i++) {
+            primMaterials[i] = faceMaterials
+                   [HdMeshUtil::DecodeFaceIndexFromCoarseFaceParam(
+                          _trianglePrimitiveParams[i])];
+        }
+    }
+    return primMaterials;
+}
+
+bool
+HdOSPRayMesh::_DemoteFaceVaryingPrimvars(
+       HdOSPRayRenderParam* renderParam, VtVec3fArray& normals,
+       HdInterpolation& normalsInterpolation, VtVec3fArray& colors,
+       HdInterpolation& colorsInterpolation, VtVec2fArray& texcoords,
+       HdInterpolation& texcoordsInterpolation)
+{
+    const bool faceVaryingNormals = !normals.empty()
+           && normalsInterpolation == HdInterpolationFaceVarying;
+    const bool faceVaryingColors = !colors.empty()
+           && colorsInterpolation == HdInterpolationFaceVarying;
+    const bool faceVaryingTexcoords = texcoords.size() > 1
+           && texcoordsInterpolation == HdInterpolationFaceVarying;
+    if (!faceVaryingNormals && !faceVaryingColors && !faceVaryingTexcoords)
+        return false;
+
+    // vertex primvars are remapped along with the points, they have to
+    // match them
+    const size_t numPoints = _points.size();
+    const bool vertexNormals
+           = !normals.empty() && _IsVertexRate(normalsInterpolation);
+    const bool vertexColors
+           = !colors.empty() && _IsVertexRate(colorsInterpolation);
+    const bool vertexTexcoords
+           = texcoords.size() > 1 && _IsVertexRate(texcoordsInterpolation);
+    if ((vertexNormals && normals.size() != numPoints)
+        || (vertexColors && colors.size() != numPoints)
+        || (vertexTexcoords && texcoords.size() != numPoints))
+        return false;
+
+    // split vertices duplicate the points and all vertex primvars
+    HdOSPRayFaceVaryingDemotion demotion;
+    size_t vertexBytes = sizeof(GfVec3f);
+    if (faceVaryingNormals)
+        demotion.AddPrimvar(normals.cdata(), normals.size(), sizeof(GfVec3f));
+    if (faceVaryingColors)
+        demotion.AddPrimvar(colors.cdata(), colors.size(), sizeof(GfVec3f));
+    if (faceVaryingTexcoords) {
+        demotion.AddPrimvar(texcoords.cdata(), texcoords.size(),
+                            sizeof(GfVec2f));
+    }
+    vertexBytes += vertexNormals ? sizeof(GfVec3f) : 0;
+    vertexBytes += vertexColors ? sizeof(GfVec3f) : 0;
+    vertexBytes += vertexTexcoords ? sizeof(GfVec2f) : 0;
+
+    if (!demotion.Compute(_topology, numPoints, vertexBytes))
+        return false;
+
+    if (faceVaryingNormals) {
+        normals = demotion.DemotePrimvar(normals);
+        normalsInterpolation = HdInterpolationVertex;
+    } else if (vertexNormals)
+        normals = demotion.RemapVertexPrimvar(normals);
+    if (faceVaryingColors) {
+        colors = demotion.DemotePrimvar(colors);
+        colorsInterpolation = HdInterpolationVertex;
+    } else if (vertexColors)
+        colors = demotion.RemapVertexPrimvar(colors);
+    if (faceVaryingTexcoords) {
+        texcoords = demotion.DemotePrimvar(texcoords);
+        texcoordsInterpolation = HdInterpolationVertex;
+    } else if (vertexTexcoords)
+        texcoords = demotion.RemapVertexPrimvar(texcoords);
+
+    _renderPoints = demotion.RemapVertexPrimvar(_points);
+    if (demotion.IsSplit()) {
+        _splitTopologyEntry = renderParam->GetTopologyRegistry().GetEntry(
+               demotion.GetTopology());
+    }
+
+    TF_DEBUG_MSG(OSP,
+                 "osp::mesh %s: demoted face-varying primvars, %zu corners "
+                 "to %zu vertices (%zu points)\n",
+                 GetId().GetText(), _topology.GetFaceVertexIndices().size(),
+                 demotion.GetNumVertices(), numPoints);
+    return true;
+}
+
+void
+HdOSPRayMesh::_CompactAttributes(bool normals, bool colors, bool texcoords)
+{
+    size_t floatBytes = 0;
+    size_t compactBytes = 0;
+    if (normals) {
+        _compactNormals = HdOSPRayCompactArray::EncodeNormals(_normals);
+        floatBytes += _compactNormals.GetDecodedByteSize();
+        compactBytes += _compactNormals.GetByteSize();
+        _normals = VtVec3fArray();
+        _computedNormals = VtVec3fArray();
+    }
+    if (colors) {
+        _compactColors = HdOSPRayCompactArray::EncodeColors(_colors);
+        floatBytes += _compactColors.GetDecodedByteSize();
+        compactBytes += _compactColors.GetByteSize();
+        _colors = VtVec3fArray();
+        _computedColors = VtVec3fArray();
+    }
+    if (texcoords) {
+        _compactTexcoords = HdOSPRayCompactArray::EncodeTexcoords(_texcoords);
+        floatBytes += _compactTexcoords.GetDecodedByteSize();
+        compactBytes += _compactTexcoords.GetByteSize();
+        _texcoords = VtVec2fArray();
+        _computedTexcoords = VtVec2fArray();
+    }
+    TF_DEBUG_MSG(OSP,
+                 "osp::mesh %s: compact attributes %zu bytes, saved %zu "
+                 "bytes\n",
+                 GetId().GetText(), compactBytes, floatBytes - compactBytes);
+}
+
+void
+HdOSPRayMesh::_RestoreCompactAttributes()
+{
+    if (_normals.empty() && !_compactNormals.IsEmpty())
+        _compactNormals.Decode(&_normals);
+    if (_colors.empty() && !_compactColors.IsEmpty())
+        _compactColors.Decode(&_colors);
+    if (_texcoords.empty() && !_compactTexcoords.IsEmpty())
+        _compactTexcoords.Decode(&_texcoords);
+    _compactNormals.Clear();
+    _compactColors.Clear();
+    _compactTexcoords.Clear();
+}
+
+void
+HdOSPRayMesh::_ReleaseSources(const std::vector<const void*>& sharedBuffers)
+{
+    auto release = [&sharedBuffers](auto& values) -> size_t {
+        if (values.size() <= 1
+            || std::find(sharedBuffers.begin(), sharedBuffers.end(),
+                         values.cdata())
+                   != sharedBuffers.end())
+            return 0;
+        const size_t bytes = values.size() * sizeof(values[0]);
+        values = std::decay_t<decltype(values)>();
+        return bytes;
+    };
+
+    // authored arrays are pulled from the scene delegate again on the next
+    // rebuild, expanded arrays recomputed
+    const size_t sourceBytes = release(_points) + release(_normals)
+           + release(_colors) + release(_texcoords);
+    const size_t computedBytes = release(_computedNormals)
+           + release(_computedColors) + release(_computedTexcoords);
+    if (sourceBytes)
+        _sourcesReleased = true;
+
+    if (sourceBytes + computedBytes) {
+        TF_DEBUG_MSG(OSP, "osp::mesh %s: released %zu bytes of host arrays\n",
+                     GetId().GetText(), sourceBytes + computedBytes);
+    }
+}
+
+int
+HdOSPRayMesh::GetMaxTessellationRate() const
+{
+    return std::max(int(MinTessellationRate), 1 << _topology.GetRefineLevel());
+}
+
+GfRange3d
+HdOSPRayMesh::GetWorldBounds() const
+{
+    return GfBBox3d(GfRange3d(_bounds), GfMatrix4d(_transform))
+           .ComputeAlignedRange();
+}
+
+bool
+HdOSPRayMesh::IsBatchable() const
+{
+    if (!_populated || !IsVisible() || !GetInstancerId().IsEmpty())
+        return false;
+    if (_refined || _useQuads || !_geometricModel || _points.empty()
+        || _triangulatedIndices.empty())
+        return false;
+    if (_triangulatedIndices.size() > size_t(std::max(
+               0, HdOSPRayConfig::GetInstance().meshBatchingMaxPrimitives)))
+        return false;
+    // per-primitive data cannot be expressed in a batch
+    if (!_topology.GetGeomSubsets().empty())
+        return false;
+    // compacted or released attributes are not kept in float format
+    if (!_compactNormals.IsEmpty() || !_compactColors.IsEmpty()
+        || !_compactTexcoords.IsEmpty() || _sourcesReleased)
+        return false;
+    if (!_normals.empty()
+        && (!_IsVertexRate(_normalsInterpolation)
+            || _normals.size() != _points.size()))
+        return false;
+    if (_texcoords.size() > 1
+        && (!_IsVertexRate(_texcoordsInterpolation)
+            || _texcoords.size() != _points.size()))
+        return false;
+    if (!_colors.empty() && _colorsInterpolation != HdInterpolationConstant
+        && (!_IsVertexRate(_colorsInterpolation)
+            || _colors.size() != _points.size()))
+        return false;
+    return true;
+}
+
+void
+HdOSPRayMesh::ReleaseBatchedInstance() const
+{
+    // the batch holds a world space copy of the mesh, the BVH of its own
+    // group is not traversed.  The geometry shares the host arrays and is
+    // kept to rebuild the group.
+    if (GetInstancerId().IsEmpty())
+        _ospInstances.clear();
+}
+
+void
+HdOSPRayMesh::GetBatchSource(HdOSPRayMeshBatchSource* source) const
+{
+    source->primId = GetPrimId();
+    source->transform = _transform;
+    source->bounds = _bounds;
+    source->points = _points;
+    source->indices = _triangulatedIndices;
+    source->normals = _normals;
+    if (_texcoords.size() > 1)
+        source->texcoords = _texcoords;
+    if (!_colors.empty()) {
+        if (_colorsInterpolation == HdInterpolationConstant) {
+            source->hasConstantColor = true;
+            source->constantColor
+                   = GfVec4f(_colors[0][0], _colors[0][1], _colors[0][2], 1.f);
+        } else {
+            source->colors = _colors;
+        }
     }
+    source->materialIndex = _materialIndex;
+    source->renderTag = _syncedRenderTag;
 }
 
 void
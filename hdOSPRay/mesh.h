@@ -4,6 +4,8 @@
 #pragma once
 
 #include <pxr/base/gf/matrix4f.h>
+#include <pxr/base/gf/range3d.h>
+#include <pxr/base/gf/range3f.h>
 #include <pxr/base/gf/vec2f.h>
 #include <pxr/base/gf/vec3f.h>
 #include <pxr/base/gf/vec4f.h>
@@ -11,14 +13,22 @@
 #include <pxr/imaging/hd/mesh.h>
 #include <pxr/imaging/hd/meshUtil.h>
 #include <pxr/imaging/hd/smoothNormals.h>
+#include <pxr/imaging/hd/tokens.h>
 #include <pxr/imaging/hd/vertexAdjacency.h>
 #include <pxr/imaging/hd/vtBufferSource.h>
 #include <pxr/imaging/pxOsd/tokens.h>
 #include <pxr/pxr.h>
 
+#include "compactAttributes.h"
+#include "config.h"
+#include "meshBatcher.h"
+#include "topologyRegistry.h"
+
 #include <ospray/ospray_cpp.h>
 #include <ospray/ospray_cpp/ext/rkcommon.h>
 
+#include <chrono>
+#include <memory>
 #include <mutex>
 
 namespace opp = ospray::cpp;
@@ -37,6 +47,9 @@ class HdOSPRayMesh final : public HdMesh {
 public:
     HF_MALLOC_TAG_NEW("new HdOSPRayMesh");
 
+    /// Lowest OSPRay subdivision level used for refined meshes
+    static constexpr int MinTessellationRate = 2;
+
     ///   \param id scenegraph path
     ///   \param instancerId
     ///
@@ -54,12 +67,68 @@ public:
                       TfToken const& reprToken) override;
 
     /// Add generated instances from sync function to the instanceList for
-    /// rendering
-    void AddOSPInstances(std::vector<opp::Instance>& instanceList) const;
+    /// rendering.  With useProxy the instances of the decimated proxy are
+    /// added instead once it has been built.  Returns true if proxy
+    /// instances were added.
+    bool AddOSPInstances(std::vector<opp::Instance>& instanceList,
+                         bool useProxy = false) const;
+
+    /// Whether the mesh is a small, static, non-instanced triangle mesh that
+    /// may be merged into a batched geometry
+    bool IsBatchable() const;
+
+    /// Fill source with the data needed for batching.  Only valid if
+    /// IsBatchable returns true.
+    void GetBatchSource(HdOSPRayMeshBatchSource* source) const;
+
+    /// Release the group and instance of a batched mesh, they are rebuilt
+    /// by AddOSPInstances once the mesh is rendered on its own again.
+    /// Called by the mesh batcher.
+    void ReleaseBatchedInstance() const;
+
+    /// Whether the mesh is a refined, non-instanced mesh whose tessellation
+    /// rate may be picked by adaptive subdivision
+    bool IsAdaptiveSubdivisionCandidate() const
+    {
+        return _populated && _refined && GetInstancerId().IsEmpty();
+    }
+
+    /// OSPRay subdivision level of the current geometry
+    int GetTessellationRate() const
+    {
+        return _tessellationRate;
+    }
+
+    /// Subdivision level requested by the display style refine level
+    int GetMaxTessellationRate() const;
+
+    size_t GetNumCoarseFaces() const
+    {
+        return _topology.GetNumFaces();
+    }
+
+    /// World space bounds of the points, ignoring instancing
+    GfRange3d GetWorldBounds() const;
+
+    /// Render tag pulled from the scene delegate in the last sync
+    TfToken const& GetSyncedRenderTag() const
+    {
+        return _syncedRenderTag;
+    }
+
+    /// Whether the mesh has been hidden for at least seconds while keeping
+    /// its OSPRay objects
+    bool IsHiddenLongerThan(double seconds) const;
+
+    /// Incremented on every edit after the initial sync
+    unsigned int GetEditVersion() const
+    {
+        return _editVersion;
+    }
 
 protected:
     bool _UseQuadIndices(const HdRenderIndex& renderIndex,
-                         HdMeshTopology const& topology) const;
+                         HdOSPRayTopologyEntry const& topologyEntry) const;
 
     virtual HdDirtyBits _PropagateDirtyBits(HdDirtyBits bits) const override;
 
@@ -81,6 +150,46 @@ private:
     void _UpdatePrimvarSources(HdSceneDelegate* sceneDelegate,
                                HdDirtyBits dirtyBits);
 
+    uint32_t _GetMaterialIndex(const HdRenderIndex& renderIndex,
+                               const SdfPath& materialId,
+                               HdOSPRayRenderParam* renderParam) const;
+
+    /// Per primitive material indices resolved from the GeomSubsets
+    std::vector<uint32_t>
+    _ComputePrimitiveMaterialIndices(const HdRenderIndex& renderIndex,
+                                     HdOSPRayRenderParam* renderParam) const;
+
+    /// Demote face-varying primvars to vertex interpolation, splitting
+    /// vertices only where corner values differ.  Updates the arrays and
+    /// interpolation modes in place and fills _renderPoints and
+    /// _splitTopologyEntry.  Returns false if nothing was demoted.
+    bool _DemoteFaceVaryingPrimvars(HdOSPRayRenderParam* renderParam,
+                                    VtVec3fArray& normals,
+                                    HdInterpolation& normalsInterpolation,
+                                    VtVec3fArray& colors,
+                                    HdInterpolation& colorsInterpolation,
+                                    VtVec2fArray& texcoords,
+                                    HdInterpolation& texcoordsInterpolation);
+
+    /// Replace the authored attribute arrays by compact copies after they
+    /// have been copied to OSPRay
+    void _CompactAttributes(bool normals, bool colors, bool texcoords);
+    /// Decode compact attribute copies for a geometry rebuild
+    void _RestoreCompactAttributes();
+    /// Lean memory mode: drop host arrays OSPRay does not read in place
+    void _ReleaseSources(const std::vector<const void*>& sharedBuffers);
+
+    /// Start building a decimated proxy of heavy meshes in the background,
+    /// see HdOSPRayConfig::interactiveProxies.  Discards the previous proxy.
+    void _UpdateProxy(HdOSPRayRenderParam* renderParam,
+                      HdOSPRayTopologyEntrySharedPtr const& indexEntry);
+    /// Drop OSPRay objects and host data of a hidden mesh and mark
+    /// everything dirty for a rebuild once it becomes visible
+    void _ReleaseHidden(HdOSPRayRenderParam* renderParam,
+                        HdDirtyBits* dirtyBits);
+    /// Let a running proxy task discard its result
+    void _CancelProxy();
+
     opp::Geometry _CreateOSPRaySubdivMesh();
     opp::Geometry _CreateOSPRayMesh(const VtVec2fArray& texcoords,
                                     const VtVec3fArray& points,
@@ -101,31 +210,35 @@ private:
     {
         if (useQuads) {
             if (interpolation == HdInterpolationFaceVarying) {
-                VtValue buffValue = VtValue(primvars);
-                HdVtBufferSource buffer(name, buffValue);
-                VtValue quadPrimvar;
-
-                auto success = meshUtil.ComputeQuadrangulatedFaceVaryingPrimvar(
-                       buffer.GetData(), buffer.GetNumElements(),
-                       buffer.GetTupleType().type, &quadPrimvar);
-                if (success && quadPrimvar.IsHolding<type>()) {
-                    computedPrimvars = quadPrimvar.Get<type>();
-                } else {
-                    TF_CODING_ERROR(
-                           "ERROR: could not quadrangulate "
-                           "face-varying data\n");
+                // quads reuse the face corners, gather one value per corner
+                const VtIntArray& corners
+                       = _topologyEntry->GetQuadFaceVaryingIndices();
+                computedPrimvars.resize(corners.size());
+                for (size_t i = 0; i < corners.size(); i++) {
+                    if (size_t(corners[i]) >= primvars.size()) {
+                        TF_CODING_ERROR(
+                               "ERROR: could not quadrangulate "
+                               "face-varying data\n");
+                        computedPrimvars = type();
+                        break;
+                    }
+                    computedPrimvars[i] = primvars[corners[i]];
                 }
             } else if (interpolation == HdInterpolationVarying
                        || interpolation == HdInterpolationVertex) {
                 computedPrimvars = primvars;
             } else if (interpolation == HdInterpolationUniform) {
-                size_t numQuads = _quadIndices.size() / 4;
-#if HD_API_VERSION < 44
-                numQuads = _quadIndices.size();
+                computedPrimvars.resize(_quadPrimitiveParams.size());
+                for (size_t i = 0; i < computedPrimvars.size(); i++) {
+#if HD_API_VERSION < 36
+                    const int coarseFaceParam = _quadPrimitiveParams[i][0];
+#else
+                    const int coarseFaceParam = _quadPrimitiveParams[i];
 #endif
-                computedPrimvars.resize(numQuads);
-                for (size_t i = 0; i < computedPrimvars.size(); i++)
-                    computedPrimvars[i] = primvars[i];
+                    computedPrimvars[i] = primvars
+                           [HdMeshUtil::DecodeFaceIndexFromCoarseFaceParam(
+                                  coarseFaceParam)];
+                }
             } else if (interpolation == HdInterpolationConstant
                        && !primvars.empty()) {
                 computedPrimvars.resize(1);
@@ -162,9 +275,9 @@ private:
                 computedPrimvars.resize(1);
                 computedPrimvars[0] = primvars[0];
             } else if (interpolation == HdInterpolationInstance) {
-                TF_WARN(
-                       "HdOSPRayMesh: unsupported interpolation mode "
-                       "HdInterpolationInstance");
+                // applied per instance from the instancer's primvars
+                TF_DEBUG_MSG(OSP, "HdOSPRayMesh: instance primvar %s\n",
+                             name.GetText());
             } else {
                 TF_WARN("HdOSPRayMesh: unknown interpolation mode");
             }
@@ -172,18 +285,50 @@ private:
     }
 
     bool _populated { false };
+    // authored arrays were dropped in lean memory mode and have to be pulled
+    // again before the next rebuild
+    bool _sourcesReleased { false };
+    std::chrono::steady_clock::time_point _hiddenSince;
+    TfToken _syncedRenderTag { HdTokens->geometry };
 
     opp::Geometry _ospMesh;
     opp::GeometricModel* _geometricModel;
-    std::vector<opp::GeometricModel> _geomSubsetModels;
+    // index into the renderer material list
+    uint32_t _materialIndex { 0 };
     // Each instance of the mesh in the top-level scene is stored in
-    // _ospInstances. This gets queried by the renderpass.
-    std::vector<opp::Instance> _ospInstances;
+    // _ospInstances. This gets queried by the renderpass.  The instance of a
+    // batched mesh is released and rebuilt on demand.
+    mutable std::vector<opp::Instance> _ospInstances;
+    // group of the instancer's instances, replaced with the geometric model
+    opp::Group _instanceGroup { nullptr };
+    // instances were created from instance-rate colors or ids
+    bool _instancePrimvars { false };
+    // material indices of _geometricModel, per primitive with GeomSubsets
+    std::vector<uint32_t> _materialIndices;
+    // transforms of _ospInstances, incremented version on every update
+    std::vector<rkcommon::math::affine3f> _instanceTransforms;
+    // instancer visibility of _instanceTransforms, empty if all are visible
+    std::vector<unsigned char> _instanceMask;
+    unsigned int _instancesVersion { 0 };
+
+    // decimated copy of a heavy mesh rendered while interacting.  Filled by a
+    // background task, which only holds on to this state.
+    struct _ProxyState {
+        std::mutex mutex;
+        bool cancelled { false };
+        opp::Group group { nullptr };
+        // instances of group for _instanceTransforms at instancesVersion
+        std::vector<opp::Instance> instances;
+        unsigned int instancesVersion { 0 };
+    };
+    std::shared_ptr<_ProxyState> _proxy;
 
     HdMeshUtil* _meshUtil { nullptr };
     HdMeshTopology _topology;
     GfMatrix4f _transform { 1 };
     VtVec3fArray _points;
+    VtVec3fArray _renderPoints; // points including split vertices
+    GfRange3f _bounds; // object space
     VtVec2fArray _texcoords;
     VtVec2fArray _computedTexcoords; // triangulated
     VtVec3fArray _normals;
@@ -194,34 +339,35 @@ private:
     HdInterpolation _texcoordsInterpolation { HdInterpolationVertex };
     HdInterpolation _colorsInterpolation { HdInterpolationVertex };
     HdInterpolation _normalsInterpolation { HdInterpolationVarying };
+    // reduced precision copies of the authored attributes, see
+    // HdOSPRayConfig::compactAttributes
+    HdOSPRayCompactArray _compactNormals;
+    HdOSPRayCompactArray _compactColors;
+    HdOSPRayCompactArray _compactTexcoords;
     TfToken _texcoordsPrimVarName;
     TfToken _colorsPrimVarName;
     TfToken _normalsPrimVarName;
 
+    // index buffers and adjacency shared with all meshes of equal topology.
+    // The arrays below reference the entry's read-only buffers.
+    HdOSPRayTopologyEntrySharedPtr _topologyEntry;
     VtVec3iArray _triangulatedIndices;
     VtIntArray _trianglePrimitiveParams;
+    HdOSPRayQuadIndexArray _quadIndices;
+    HdOSPRayQuadPrimitiveParamArray _quadPrimitiveParams;
+    // topology over _renderPoints if face-varying demotion split vertices
+    HdOSPRayTopologyEntrySharedPtr _splitTopologyEntry;
 
-#if HD_API_VERSION < 44
-    VtVec4iArray _quadIndices;
-#else
-    VtIntArray _quadIndices;
-#endif
-#if HD_API_VERSION < 36
-    VtVec2iArray _quadPrimitiveParams;
-#else
-    VtIntArray _quadPrimitiveParams;
-#endif
-
-    Hd_VertexAdjacency _adjacency;
-    bool _adjacencyValid;
     bool _normalsValid;
 
     // Draw styles.
     bool _refined;
+    bool _useQuads { false };
     bool _smoothNormals { false };
     bool _doubleSided { false };
     HdCullStyle _cullStyle;
     int _tessellationRate { 32 };
+    unsigned int _editVersion { 0 };
     std::mutex _mutex;
 
     // This class does not support copying.
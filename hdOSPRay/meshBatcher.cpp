@@ -0,0 +1,355 @@
+// Copyright 2019 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include "meshBatcher.h"
+#include "config.h"
+#include "mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace rkcommon::math;
+
+namespace {
+
+// attribute layout bits, meshes only share a batch with equal layouts
+enum _BatchAttributes {
+    _HasNormals = 1 << 0,
+    _HasTexcoords = 1 << 1,
+    _HasColors = 1 << 2,
+    _HasConstantColor = 1 << 3
+};
+
+uint64_t
+_GetAttributeMask(const HdOSPRayMeshBatchSource& source)
+{
+    uint64_t mask = 0;
+    if (!source.normals.empty())
+        mask |= _HasNormals;
+    if (!source.texcoords.empty())
+        mask |= _HasTexcoords;
+    if (!source.colors.empty())
+        mask |= _HasColors;
+    if (source.hasConstantColor)
+        mask |= _HasConstantColor;
+    return mask;
+}
+
+GfVec3f
+_GetWorldCenter(const HdOSPRayMeshBatchSource& source)
+{
+    return source.transform.Transform(source.bounds.GetMidpoint());
+}
+
+} // namespace
+
+void
+HdOSPRayMeshBatcher::Update(const std::vector<const HdOSPRayMesh*>& meshes)
+{
+    std::vector<const HdOSPRayMesh*> newMeshes;
+    std::vector<HdOSPRayMeshBatchSource> newSources;
+
+    for (const HdOSPRayMesh* mesh : meshes) {
+        auto it = _meshCells.find(mesh);
+        if (it != _meshCells.end()) {
+            if (it->second.editVersion != mesh->GetEditVersion()) {
+                // animated or edited, split out and keep it separate
+                _dynamicMeshes.insert(mesh);
+                _RemoveFromCell(mesh);
+            } else if (!mesh->IsBatchable()) {
+                // e.g. hidden, may be batched again later
+                _RemoveFromCell(mesh);
+            }
+            continue;
+        }
+        if (_dynamicMeshes.find(mesh) != _dynamicMeshes.end()
+            || !mesh->IsBatchable())
+            continue;
+
+        newMeshes.push_back(mesh);
+        newSources.emplace_back();
+        mesh->GetBatchSource(&newSources.back());
+    }
+
+    if (!newSources.empty() && !_gridValid)
+        _InitGrid(newSources);
+
+    for (size_t i = 0; i < newMeshes.size(); i++) {
+        const uint64_t key = _ComputeCellKey(newSources[i]);
+        _Cell& cell = _cells[key];
+        cell.members.push_back(newMeshes[i]);
+        cell.dirty = true;
+        _meshCells[newMeshes[i]] = { key, newMeshes[i]->GetEditVersion() };
+        newMeshes[i]->ReleaseBatchedInstance();
+    }
+
+    for (auto it = _cells.begin(); it != _cells.end();) {
+        _Cell& cell = it->second;
+        if (cell.dirty) {
+            _ReleaseBatchIds(cell);
+            if (cell.members.empty()) {
+                it = _cells.erase(it);
+                continue;
+            }
+            _BuildCell(cell);
+        }
+        ++it;
+    }
+}
+
+void
+HdOSPRayMeshBatcher::RemoveMesh(const HdOSPRayMesh* mesh)
+{
+    _RemoveFromCell(mesh);
+    // the address may be reused by a new mesh
+    _dynamicMeshes.erase(mesh);
+}
+
+void
+HdOSPRayMeshBatcher::AddOSPInstances(
+       std::vector<opp::Instance>& instanceList,
+       const std::function<bool(const HdOSPRayMesh*)>& accept,
+       std::vector<const HdOSPRayMesh*>& splitMeshes) const
+{
+    for (const auto& it : _cells) {
+        const _Cell& cell = it.second;
+        if (!cell.instance)
+            continue;
+        if (std::all_of(cell.members.begin(), cell.members.end(), accept)) {
+            instanceList.push_back(cell.instance);
+            continue;
+        }
+        for (const HdOSPRayMesh* mesh : cell.members) {
+            if (accept(mesh))
+                splitMeshes.push_back(mesh);
+        }
+    }
+}
+
+void
+HdOSPRayMeshBatcher::ResolveIds(unsigned int& objectId,
+                                unsigned int& primitiveId) const
+{
+    // background pixels are all bits set
+    if (!(objectId & BatchIdBit)
+        || objectId == std::numeric_limits<unsigned int>::max())
+        return;
+
+    const uint32_t batchId = objectId & ~BatchIdBit;
+    if (batchId >= _batchIds.size())
+        return;
+    const _BatchIds& ids = _batchIds[batchId];
+    if (ids.primIds.empty())
+        return;
+
+    auto it = std::upper_bound(ids.primOffsets.begin(), ids.primOffsets.end(),
+                               primitiveId);
+    if (it == ids.primOffsets.begin() || it == ids.primOffsets.end())
+        return;
+    const size_t member = (it - ids.primOffsets.begin()) - 1;
+    objectId = ids.primIds[member];
+    primitiveId -= ids.primOffsets[member];
+}
+
+uint64_t
+HdOSPRayMeshBatcher::_ComputeCellKey(
+       const HdOSPRayMeshBatchSource& source) const
+{
+    const GfVec3f cellCoords
+           = (_GetWorldCenter(source) - _gridOrigin) / _cellSize;
+    uint64_t key = _GetAttributeMask(source);
+    for (int axis = 0; axis < 3; axis++) {
+        const float c = std::max(
+               -32768.f, std::min(32767.f, std::floor(cellCoords[axis])));
+        key |= uint64_t(int(c) + 32768) << (4 + 16 * axis);
+    }
+    // separate render tags so that filtering by tag rarely splits a cell
+    key |= uint64_t(source.renderTag.Hash() & 0xfff) << 52;
+    return key;
+}
+
+void
+HdOSPRayMeshBatcher::_InitGrid(
+       const std::vector<HdOSPRayMeshBatchSource>& sources)
+{
+    // the grid is fixed on first use so that meshes added later only touch
+    // their own cell
+    GfRange3f bounds;
+    for (const auto& source : sources)
+        bounds.UnionWith(_GetWorldCenter(source));
+
+    const int resolution = std::max(
+           1, HdOSPRayConfig::GetInstance().meshBatchingGridResolution);
+    const GfVec3f size = bounds.GetSize();
+    const float extent = std::max(size[0], std::max(size[1], size[2]));
+    _gridOrigin = bounds.GetMin();
+    _cellSize = extent > 0.f ? extent / resolution : 1.f;
+    _gridValid = true;
+}
+
+void
+HdOSPRayMeshBatcher::_RemoveFromCell(const HdOSPRayMesh* mesh)
+{
+    auto it = _meshCells.find(mesh);
+    if (it == _meshCells.end())
+        return;
+
+    auto cellIt = _cells.find(it->second.cellKey);
+    if (cellIt != _cells.end()) {
+        auto& members = cellIt->second.members;
+        members.erase(std::remove(members.begin(), members.end(), mesh),
+                      members.end());
+        cellIt->second.dirty = true;
+    }
+    _meshCells.erase(it);
+}
+
+void
+HdOSPRayMeshBatcher::_BuildCell(_Cell& cell)
+{
+    std::vector<HdOSPRayMeshBatchSource> sources(cell.members.size());
+    for (size_t i = 0; i < cell.members.size(); i++)
+        cell.members[i]->GetBatchSource(&sources[i]);
+
+    std::vector<opp::GeometricModel> models;
+    for (size_t begin = 0; begin < sources.size();
+         begin += MaxMeshesPerBatch) {
+        const size_t end = std::min(sources.size(), begin + MaxMeshesPerBatch);
+        const uint32_t batchId = _AcquireBatchId();
+        cell.batchIds.push_back(batchId);
+        models.push_back(_BuildBatch(sources, begin, end, batchId));
+    }
+
+    opp::Group group;
+    group.setParam("geometry", opp::CopiedData(models));
+    group.commit();
+    cell.instance = opp::Instance(group);
+    cell.instance.setParam("id", (unsigned int)0);
+    cell.instance.commit();
+    cell.dirty = false;
+
+    TF_DEBUG_MSG(OSP, "ospMeshBatcher: %zu meshes in %zu batches\n",
+                 sources.size(), models.size());
+}
+
+opp::GeometricModel
+HdOSPRayMeshBatcher::_BuildBatch(
+       const std::vector<HdOSPRayMeshBatchSource>& sources, size_t begin,
+       size_t end, uint32_t batchId)
+{
+    // all members of a cell share the attribute layout
+    const uint64_t mask = _GetAttributeMask(sources[begin]);
+
+    size_t numVertices = 0;
+    size_t numPrims = 0;
+    for (size_t i = begin; i < end; i++) {
+        numVertices += sources[i].points.size();
+        numPrims += sources[i].indices.size();
+    }
+
+    std::vector<vec3f> positions;
+    std::vector<vec3ui> indices;
+    std::vector<vec3f> normals;
+    std::vector<vec2f> texcoords;
+    std::vector<vec3f> colors;
+    std::vector<uint8_t> materialIndices;
+    std::vector<uint32_t> materials;
+    std::vector<vec4f> modelColors;
+    positions.reserve(numVertices);
+    indices.reserve(numPrims);
+    materialIndices.reserve(numPrims);
+    if (mask & _HasNormals)
+        normals.reserve(numVertices);
+    if (mask & _HasTexcoords)
+        texcoords.reserve(numVertices);
+    if (mask & _HasColors)
+        colors.reserve(numVertices);
+
+    _BatchIds& ids = _batchIds[batchId];
+    ids.primOffsets.clear();
+    ids.primIds.clear();
+
+    for (size_t i = begin; i < end; i++) {
+        const HdOSPRayMeshBatchSource& source = sources[i];
+        const unsigned int vertexOffset = positions.size();
+        ids.primOffsets.push_back(indices.size());
+        ids.primIds.push_back(source.primId);
+
+        // bake the transform into the merged vertices
+        for (const GfVec3f& p : source.points) {
+            const GfVec3f wp = source.transform.Transform(p);
+            positions.emplace_back(wp[0], wp[1], wp[2]);
+        }
+        if (mask & _HasNormals) {
+            const GfMatrix4f normalXfm
+                   = source.transform.GetInverse().GetTranspose();
+            for (const GfVec3f& n : source.normals) {
+                const GfVec3f wn = normalXfm.TransformDir(n).GetNormalized();
+                normals.emplace_back(wn[0], wn[1], wn[2]);
+            }
+        }
+        if (mask & _HasTexcoords) {
+            for (const GfVec2f& t : source.texcoords)
+                texcoords.emplace_back(t[0], t[1]);
+        }
+        if (mask & _HasColors) {
+            for (const GfVec3f& c : source.colors)
+                colors.emplace_back(c[0], c[1], c[2]);
+        }
+        for (const GfVec3i& tri : source.indices) {
+            indices.emplace_back(tri[0] + vertexOffset, tri[1] + vertexOffset,
+                                 tri[2] + vertexOffset);
+        }
+        materialIndices.insert(materialIndices.end(), source.indices.size(),
+                               uint8_t(i - begin));
+        materials.push_back(source.materialIndex);
+        const GfVec4f& c = source.constantColor;
+        modelColors.emplace_back(c[0], c[1], c[2], c[3]);
+    }
+    ids.primOffsets.push_back(indices.size());
+
+    // copied, the merged arrays are not retained on the host
+    opp::Geometry geometry("mesh");
+    geometry.setParam("vertex.position", opp::CopiedData(positions));
+    geometry.setParam("index", opp::CopiedData(indices));
+    if (mask & _HasNormals)
+        geometry.setParam("vertex.normal", opp::CopiedData(normals));
+    if (mask & _HasTexcoords)
+        geometry.setParam("vertex.texcoord", opp::CopiedData(texcoords));
+    if (mask & _HasColors)
+        geometry.setParam("vertex.color", opp::CopiedData(colors));
+    geometry.commit();
+
+    opp::GeometricModel model(geometry);
+    model.setParam("material", opp::CopiedData(materials));
+    model.setParam("index", opp::CopiedData(materialIndices));
+    if (mask & _HasConstantColor)
+        model.setParam("color", opp::CopiedData(modelColors));
+    model.setParam("id", (unsigned int)(BatchIdBit | batchId));
+    model.commit();
+    return model;
+}
+
+uint32_t
+HdOSPRayMeshBatcher::_AcquireBatchId()
+{
+    if (!_freeBatchIds.empty()) {
+        const uint32_t batchId = _freeBatchIds.back();
+        _freeBatchIds.pop_back();
+        return batchId;
+    }
+    _batchIds.emplace_back();
+    return _batchIds.size() - 1;
+}
+
+void
+HdOSPRayMeshBatcher::_ReleaseBatchIds(_Cell& cell)
+{
+    for (const uint32_t batchId : cell.batchIds) {
+        _batchIds[batchId] = _BatchIds();
+        _freeBatchIds.push_back(batchId);
+    }
+    cell.batchIds.clear();
+    cell.instance = nullptr;
+}
@@ -0,0 +1,139 @@
+// Copyright 2019 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <pxr/base/gf/matrix4f.h>
+#include <pxr/base/gf/range3f.h>
+#include <pxr/base/gf/vec3f.h>
+#include <pxr/base/gf/vec4f.h>
+#include <pxr/base/tf/token.h>
+#include <pxr/base/vt/array.h>
+#include <pxr/base/vt/types.h>
+#include <pxr/pxr.h>
+
+#include <ospray/ospray_cpp.h>
+#include <ospray/ospray_cpp/ext/rkcommon.h>
+
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace opp = ospray::cpp;
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+class HdOSPRayMesh;
+
+/// \struct HdOSPRayMeshBatchSource
+///
+/// Object space data of a static triangle mesh handed to the batcher.  All
+/// optional attributes are per vertex.
+///
+struct HdOSPRayMeshBatchSource {
+    int primId { -1 };
+    GfMatrix4f transform { 1 };
+    GfRange3f bounds;
+    VtVec3fArray points;
+    VtVec3iArray indices;
+    VtVec3fArray normals;
+    VtVec2fArray texcoords;
+    VtVec3fArray colors;
+    bool hasConstantColor { false };
+    GfVec4f constantColor { 1.f, 1.f, 1.f, 1.f };
+    uint32_t materialIndex { 0 }; // into the renderer material list
+    TfToken renderTag; // meshes of different tags are kept apart
+};
+
+/// \class HdOSPRayMeshBatcher
+///
+/// Merges small, static, non-instanced meshes that lie close to each other
+/// into shared geometries to shrink the top-level BVH.  Meshes are binned
+/// into a uniform grid by world space bounds center; every cell holds one
+/// group with up to 256 meshes per geometric model, each mesh addressed by a
+/// per-primitive uint8 index into the model's material and color arrays.
+///
+/// Batched models carry a reserved id (BatchIdBit set) so picking AOVs can be
+/// mapped back to the original prim id and element with ResolveIds.  Meshes
+/// edited after they have been batched are split out of their cell and render
+/// as individual instances from then on.
+///
+/// Not thread safe; called from the render pass and from rprim Finalize.
+///
+class HdOSPRayMeshBatcher {
+public:
+    static constexpr uint32_t BatchIdBit = 0x80000000u;
+    static constexpr size_t MaxMeshesPerBatch = 256;
+
+    HdOSPRayMeshBatcher() = default;
+    ~HdOSPRayMeshBatcher() = default;
+
+    /// Bin new eligible meshes, split out edited ones and rebuild the cells
+    /// that changed.
+    void Update(const std::vector<const HdOSPRayMesh*>& meshes);
+
+    /// Forget about mesh, e.g. when it is deleted.
+    void RemoveMesh(const HdOSPRayMesh* mesh);
+
+    /// Whether mesh is rendered as part of a batch.
+    bool IsBatched(const HdOSPRayMesh* mesh) const
+    {
+        return _meshCells.find(mesh) != _meshCells.end();
+    }
+
+    /// Add the instances of all batched cells to instanceList.  Cells with
+    /// members rejected by accept are not added, their accepted members are
+    /// appended to splitMeshes to be rendered as individual instances.
+    void AddOSPInstances(
+           std::vector<opp::Instance>& instanceList,
+           const std::function<bool(const HdOSPRayMesh*)>& accept,
+           std::vector<const HdOSPRayMesh*>& splitMeshes) const;
+
+    /// Map object and primitive ids of batched geometry back to the prim id
+    /// and element of the source mesh.  Ids of unbatched geometry are left
+    /// untouched.
+    void ResolveIds(unsigned int& objectId, unsigned int& primitiveId) const;
+
+private:
+    struct _MeshEntry {
+        uint64_t cellKey;
+        unsigned int editVersion;
+    };
+
+    struct _Cell {
+        std::vector<const HdOSPRayMesh*> members;
+        std::vector<uint32_t> batchIds;
+        opp::Instance instance { nullptr };
+        bool dirty { true };
+    };
+
+    // prefix sum of primitive offsets and prim id per mesh of one batch
+    struct _BatchIds {
+        std::vector<uint32_t> primOffsets;
+        std::vector<int> primIds;
+    };
+
+    uint64_t _ComputeCellKey(const HdOSPRayMeshBatchSource& source) const;
+    void _InitGrid(const std::vector<HdOSPRayMeshBatchSource>& sources);
+    void _RemoveFromCell(const HdOSPRayMesh* mesh);
+    void _BuildCell(_Cell& cell);
+    opp::GeometricModel _BuildBatch(
+           const std::vector<HdOSPRayMeshBatchSource>& sources, size_t begin,
+           size_t end, uint32_t batchId);
+    uint32_t _AcquireBatchId();
+    void _ReleaseBatchIds(_Cell& cell);
+
+    std::unordered_map<uint64_t, _Cell> _cells;
+    std::unordered_map<const HdOSPRayMesh*, _MeshEntry> _meshCells;
+    // meshes edited after being batched, never batched again
+    std::unordered_set<const HdOSPRayMesh*> _dynamicMeshes;
+
+    std::vector<_BatchIds> _batchIds;
+    std::vector<uint32_t> _freeBatchIds;
+
+    bool _gridValid { false };
+    GfVec3f _gridOrigin { 0.f };
+    float _cellSize { 1.f };
+};
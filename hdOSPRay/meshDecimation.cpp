@@ -0,0 +1,141 @@
+// Copyright 2019 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include "meshDecimation.h"
+
+#include <pxr/base/gf/range3f.h>
+#include <pxr/base/gf/vec3d.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+// cell coordinates are packed into 21 bits per axis
+constexpr int _cellBits = 21;
+constexpr uint64_t _maxCell = (uint64_t(1) << _cellBits) - 1;
+
+uint64_t
+_CellCoordinate(float value, float origin, float invCellSize)
+{
+    const float cell = std::floor((value - origin) * invCellSize);
+    return uint64_t(std::max(0.f, std::min(float(_maxCell), cell)));
+}
+
+bool
+_TriangleLess(GfVec3i const& a, GfVec3i const& b)
+{
+    return std::lexicographical_compare(a.data(), a.data() + 3, b.data(),
+                                        b.data() + 3);
+}
+
+} // namespace
+
+bool
+HdOSPRayDecimateMesh(VtVec3fArray const& points, VtVec3iArray const& triangles,
+                     size_t targetTriangles, VtVec3fArray* decimatedPoints,
+                     VtVec3iArray* decimatedTriangles)
+{
+    if (points.empty() || targetTriangles == 0
+        || triangles.size() <= targetTriangles)
+        return false;
+
+    const int numPoints = int(points.size());
+    auto validTriangle = [numPoints](GfVec3i const& t) {
+        return t[0] >= 0 && t[0] < numPoints && t[1] >= 0 && t[1] < numPoints
+               && t[2] >= 0 && t[2] < numPoints;
+    };
+
+    GfRange3f bounds;
+    double area = 0.0;
+    for (GfVec3i const& t : triangles) {
+        if (!validTriangle(t))
+            continue;
+        const GfVec3f& p0 = points[t[0]];
+        const GfVec3f& p1 = points[t[1]];
+        const GfVec3f& p2 = points[t[2]];
+        bounds.UnionWith(p0);
+        bounds.UnionWith(p1);
+        bounds.UnionWith(p2);
+        area += 0.5 * GfCross(p1 - p0, p2 - p0).GetLength();
+    }
+    if (bounds.IsEmpty() || !(area > 0.0))
+        return false;
+
+    // a cell of size h covers about h^2 of the surface and yields one point,
+    // i.e. two triangles of the decimated mesh
+    const GfVec3f extent = bounds.GetSize();
+    const float maxExtent = std::max(extent[0], std::max(extent[1], extent[2]));
+    const float cellSize
+           = std::max(float(std::sqrt(2.0 * area / double(targetTriangles))),
+                      maxExtent / float(_maxCell));
+    const float invCellSize = 1.f / cellSize;
+    const GfVec3f origin = bounds.GetMin();
+
+    // average the referenced points of every occupied cell
+    std::unordered_map<uint64_t, int> cells;
+    cells.reserve(targetTriangles);
+    std::vector<int> remap(points.size(), -1);
+    std::vector<GfVec3d> sums;
+    std::vector<int> counts;
+    for (GfVec3i const& t : triangles) {
+        if (!validTriangle(t))
+            continue;
+        for (int c = 0; c < 3; c++) {
+            const int index = t[c];
+            if (remap[index] >= 0)
+                continue;
+            const GfVec3f& p = points[index];
+            const uint64_t key = _CellCoordinate(p[0], origin[0], invCellSize)
+                   | (_CellCoordinate(p[1], origin[1], invCellSize)
+                      << _cellBits)
+                   | (_CellCoordinate(p[2], origin[2], invCellSize)
+                      << (2 * _cellBits));
+            auto inserted = cells.emplace(key, int(sums.size()));
+            if (inserted.second) {
+                sums.emplace_back(0.0);
+                counts.push_back(0);
+            }
+            const int cell = inserted.first->second;
+            remap[index] = cell;
+            sums[cell] += GfVec3d(p);
+            counts[cell]++;
+        }
+    }
+
+    // drop collapsed triangles.  Rotating the smallest index first keeps the
+    // orientation and makes duplicates adjacent after sorting.
+    std::vector<GfVec3i> clustered;
+    clustered.reserve(std::min(triangles.size(), 2 * targetTriangles));
+    for (GfVec3i const& t : triangles) {
+        if (!validTriangle(t))
+            continue;
+        const int a = remap[t[0]];
+        const int b = remap[t[1]];
+        const int c = remap[t[2]];
+        if (a == b || b == c || a == c)
+            continue;
+        if (a < b && a < c)
+            clustered.emplace_back(a, b, c);
+        else if (b < c)
+            clustered.emplace_back(b, c, a);
+        else
+            clustered.emplace_back(c, a, b);
+    }
+    std::sort(clustered.begin(), clustered.end(), _TriangleLess);
+    clustered.erase(std::unique(clustered.begin(), clustered.end()),
+                    clustered.end());
+    if (clustered.empty() || clustered.size() >= triangles.size())
+        return false;
+
+    decimatedPoints->resize(sums.size());
+    GfVec3f* dstPoints = decimatedPoints->data();
+    for (size_t i = 0; i < sums.size(); i++)
+        dstPoints[i] = GfVec3f(sums[i] / double(counts[i]));
+
+    decimatedTriangles->assign(clustered.begin(), clustered.end());
+    return true;
+}
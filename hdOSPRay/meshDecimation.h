@@ -0,0 +1,24 @@
+// Copyright 2019 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <pxr/base/vt/array.h>
+#include <pxr/base/vt/types.h>
+#include <pxr/pxr.h>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+/// Simplify a triangle mesh to roughly targetTriangles triangles by vertex
+/// clustering.  Points are merged per cell of a uniform grid whose cell size
+/// is derived from the surface area, collapsed and duplicate triangles are
+/// dropped.  Clustering is fast and robust for any input, but does not
+/// preserve topology, which is fine for proxies displayed while interacting.
+///
+/// Returns false if the mesh is already below the target or could not be
+/// reduced.
+bool HdOSPRayDecimateMesh(VtVec3fArray const& points,
+                          VtVec3iArray const& triangles,
+                          size_t targetTriangles,
+                          VtVec3fArray* decimatedPoints,
+                          VtVec3iArray* decimatedTriangles);
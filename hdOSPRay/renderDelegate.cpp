@@ -115,6 +115,11 @@ HdOSPRayRenderDelegate::_Initialize()
              HdOSPRayRenderSettingsTokens->interactiveTargetFPS,
              VtValue(float(
                     HdOSPRayConfig::GetInstance().interactiveTargetFPS)) });
+    _settingDescriptors.push_back(
+           { "interactiveStrandFraction",
+             HdOSPRayRenderSettingsTokens->interactiveStrandFraction,
+             VtValue(float(HdOSPRayConfig::GetInstance()
+                                  .interactiveStrandFraction)) });
     if (!HdOSPRayConfig::GetInstance().usePathTracing) {
         _settingDescriptors.push_back(
                { "Ambient occlusion samples",
@@ -180,6 +185,10 @@ HdOSPRayRenderDelegate::_Initialize()
 
 HdOSPRayRenderDelegate::~HdOSPRayRenderDelegate()
 {
+    // background tasks create OSPRay objects, they must finish before the
+    // texture cache is cleared and OSPRay is shut down
+    _renderParam->WaitBackgroundTasks();
+
     std::lock_guard<std::mutex> guard(_mutexResourceRegistry);
 
     if (_counterResourceRegistry.fetch_sub(1) == 1) {
@@ -202,6 +211,7 @@ HdOSPRayRenderDelegate::CommitResources(HdChangeTracker* tracker)
     const auto modelVersion = rp->GetModelVersion();
     if (modelVersion > _lastCommittedModelVersion) {
         _lastCommittedModelVersion = modelVersion;
+        rp->GetTopologyRegistry().GarbageCollect();
     }
 }
 
@@ -24,6 +24,7 @@ PXR_NAMESPACE_USING_DIRECTIVE
     (aoIntensity)(samplesToConvergence)(ambientLight)(eyeLight)(keyLight)      \
     (fillLight)(backLight)(pathTracer)(staticDirectionalLights)                \
     (minContribution)(maxContribution)(interactiveTargetFPS)                   \
+    (interactiveStrandFraction)                                                \
     (useTextureGammaCorrection)(tmp_exposure)(tmp_enabled)(tmp_contrast)       \
     (tmp_shoulder)(tmp_midIn)(tmp_midOut)(tmp_hdrMax)(tmp_acesColor)           \
     (shadowCatcherPlane)(geometryLights)
@@ -3,20 +3,39 @@
 
 #pragma once
 
+#include <pxr/base/work/dispatcher.h>
 #include <pxr/imaging/hd/renderDelegate.h>
 #include <pxr/pxr.h>
 
 #include "basisCurves.h"
 #include "lights/light.h"
+#include "material.h"
 #include "mesh.h"
+#include "meshBatcher.h"
+#include "topologyRegistry.h"
 
 #include <ospray/ospray_cpp.h>
 #include <ospray/ospray_cpp/ext/rkcommon.h>
 
+#include <algorithm>
+#include <functional>
+
 namespace opp = ospray::cpp;
 
 PXR_NAMESPACE_USING_DIRECTIVE
 
+class HdOSPRayRenderParam;
+
+/// Textures decoded in the background.  Shared with the loading tasks,
+/// which the render delegate joins before it releases the render param.
+struct HdOSPRayTextureUpdates {
+    std::mutex mutex;
+    // number of textures being decoded
+    int loading { 0 };
+    // apply decoded textures to their materials, run by the render pass
+    std::vector<std::function<void(HdOSPRayRenderParam*)>> updates;
+};
+
 ///
 /// \class HdOSPRayRenderParam
 ///
@@ -25,9 +44,14 @@ PXR_NAMESPACE_USING_DIRECTIVE
 ///
 class HdOSPRayRenderParam final : public HdRenderParam {
 public:
+    /// Index of the default material in the renderer material list
+    static constexpr uint32_t DefaultMaterialIndex = 0;
+
     HdOSPRayRenderParam(opp::Renderer renderer)
         : _renderer(std::move(renderer))
     {
+        _materials.push_back(HdOSPRayMaterial::CreateDefaultMaterial(
+               GfVec4f(.5f, .5f, .5f, 1.f)));
     }
     virtual ~HdOSPRayRenderParam() = default;
 
@@ -46,6 +70,18 @@ public:
         return _modelVersion.load();
     }
 
+    // thread safe.  Transforms of existing instances changed, worlds only
+    // need to be recommitted.
+    void UpdateInstanceVersion()
+    {
+        _instanceVersion++;
+    }
+
+    int GetInstanceVersion()
+    {
+        return _instanceVersion.load();
+    }
+
     void UpdateLightVersion()
     {
         _lightVersion++;
@@ -66,6 +102,61 @@ public:
         return _materialVersion.load();
     }
 
+    // thread safe.  Index of material id in the renderer material list,
+    // registering material if id is not in the list yet.
+    uint32_t GetMaterialIndex(const SdfPath& id, const opp::Material& material)
+    {
+        std::lock_guard<std::mutex> lock(_materialMutex);
+        auto it = _materialIndices.find(id);
+        if (it != _materialIndices.end())
+            return it->second;
+        const uint32_t index = _materials.size();
+        _materials.push_back(material);
+        _materialIndices[id] = index;
+        _materialListVersion++;
+        return index;
+    }
+
+    // thread safe.  Set the OSPRay material of material id.  Indices are
+    // stable, so meshes referencing id do not need to be updated.
+    void SetMaterial(const SdfPath& id, const opp::Material& material)
+    {
+        std::lock_guard<std::mutex> lock(_materialMutex);
+        auto it = _materialIndices.find(id);
+        if (it == _materialIndices.end()) {
+            _materialIndices[id] = _materials.size();
+            _materials.push_back(material);
+        } else if (_materials[it->second].handle() != material.handle()) {
+            _materials[it->second] = material;
+        } else {
+            return;
+        }
+        _materialListVersion++;
+    }
+
+    // thread safe.  Revert material id to the default material.
+    void ResetMaterial(const SdfPath& id)
+    {
+        std::lock_guard<std::mutex> lock(_materialMutex);
+        auto it = _materialIndices.find(id);
+        if (it == _materialIndices.end())
+            return;
+        _materials[it->second] = _materials[DefaultMaterialIndex];
+        _materialListVersion++;
+    }
+
+    int GetMaterialListVersion()
+    {
+        return _materialListVersion.load();
+    }
+
+    // thread safe.  Copy of the renderer material list.
+    std::vector<opp::Material> GetMaterialList()
+    {
+        std::lock_guard<std::mutex> lock(_materialMutex);
+        return _materials;
+    }
+
     // thread safe.  Lights added to scene and released by renderPass.
     void AddHdOSPRayLight(const SdfPath& id, const HdOSPRayLight* hdOsprayLight)
     {
@@ -94,10 +185,28 @@ public:
     void AddHdOSPRayMesh(const HdOSPRayMesh* hdOsprayMesh)
     {
         std::lock_guard<std::mutex> lock(_ospMutex);
+        _hdOSPRayMeshIndices[hdOsprayMesh] = _hdOSPRayMeshes.size();
         _hdOSPRayMeshes.push_back(hdOsprayMesh);
         UpdateModelVersion();
     }
 
+    // thread safe.  Called when a mesh is finalized.
+    void RemoveHdOSPRayMesh(const HdOSPRayMesh* hdOsprayMesh)
+    {
+        std::lock_guard<std::mutex> lock(_ospMutex);
+        auto it = _hdOSPRayMeshIndices.find(hdOsprayMesh);
+        if (it == _hdOSPRayMeshIndices.end())
+            return;
+        // swap with last to keep removal constant time
+        const size_t index = it->second;
+        _hdOSPRayMeshes[index] = _hdOSPRayMeshes.back();
+        _hdOSPRayMeshIndices[_hdOSPRayMeshes[index]] = index;
+        _hdOSPRayMeshes.pop_back();
+        _hdOSPRayMeshIndices.erase(hdOsprayMesh);
+        _meshBatcher.RemoveMesh(hdOsprayMesh);
+        UpdateModelVersion();
+    }
+
     // thread safe.  Lights added to scene and released by renderPass.
     void AddHdOSPRayBasisCurves(const HdOSPRayBasisCurves* hdOsprayBasisCurves)
     {
@@ -106,6 +215,21 @@ public:
         UpdateModelVersion();
     }
 
+    // thread safe.  Called when curves are finalized.
+    void RemoveHdOSPRayBasisCurves(
+           const HdOSPRayBasisCurves* hdOsprayBasisCurves)
+    {
+        std::lock_guard<std::mutex> lock(_ospMutex);
+        auto it = std::find(_hdOSPRayBasisCurves.begin(),
+                            _hdOSPRayBasisCurves.end(), hdOsprayBasisCurves);
+        if (it == _hdOSPRayBasisCurves.end())
+            return;
+        // swap with last, the order of instances does not matter
+        *it = _hdOSPRayBasisCurves.back();
+        _hdOSPRayBasisCurves.pop_back();
+        UpdateModelVersion();
+    }
+
     // not thread safe
     const std::vector<const HdOSPRayMesh*>& GetHdOSPRayMeshes()
     {
@@ -118,6 +242,96 @@ public:
         return _hdOSPRayBasisCurves;
     }
 
+    // not thread safe.  Merged geometries of small static meshes.
+    HdOSPRayMeshBatcher& GetMeshBatcher()
+    {
+        return _meshBatcher;
+    }
+
+    // thread safe.  Subdivision level picked by adaptive subdivision for
+    // mesh id, 0 if none has been picked yet.
+    int GetSubdivisionLevel(const SdfPath& id)
+    {
+        std::lock_guard<std::mutex> lock(_subdivisionMutex);
+        auto it = _subdivisionLevels.find(id);
+        return it != _subdivisionLevels.end() ? it->second : 0;
+    }
+
+    // thread safe
+    void SetSubdivisionLevel(const SdfPath& id, int level)
+    {
+        std::lock_guard<std::mutex> lock(_subdivisionMutex);
+        _subdivisionLevels[id] = level;
+    }
+
+    // thread safe.  Called when a mesh is finalized.
+    void ClearSubdivisionLevel(const SdfPath& id)
+    {
+        std::lock_guard<std::mutex> lock(_subdivisionMutex);
+        _subdivisionLevels.erase(id);
+    }
+
+    // thread safe.  Called by background tasks whenever a mesh proxy has
+    // been built.
+    void UpdateProxyVersion()
+    {
+        _proxyVersion++;
+    }
+
+    int GetProxyVersion()
+    {
+        return _proxyVersion.load();
+    }
+
+    // thread safe.  Queue of textures decoded in the background.
+    std::shared_ptr<HdOSPRayTextureUpdates> GetTextureUpdates()
+    {
+        return _textureUpdates;
+    }
+
+    // thread safe.  Whether textures are being decoded or waiting to be
+    // applied.
+    bool IsLoadingTextures()
+    {
+        std::lock_guard<std::mutex> lock(_textureUpdates->mutex);
+        return _textureUpdates->loading > 0
+               || !_textureUpdates->updates.empty();
+    }
+
+    // not thread safe.  Apply decoded textures to their materials, called
+    // by the render pass between syncs.
+    void ApplyTextureUpdates()
+    {
+        std::vector<std::function<void(HdOSPRayRenderParam*)>> updates;
+        {
+            std::lock_guard<std::mutex> lock(_textureUpdates->mutex);
+            updates.swap(_textureUpdates->updates);
+        }
+        for (auto& update : updates)
+            update(this);
+    }
+
+    // thread safe.  Run task in the background.  Tasks creating OSPRay
+    // objects must be run here, they are joined before OSPRay is shut down.
+    template <class Fn>
+    void RunBackgroundTask(Fn&& fn)
+    {
+        _backgroundTasks.Run(std::forward<Fn>(fn));
+    }
+
+    // not thread safe.  Wait for all background tasks, called by the render
+    // delegate when it is destroyed.
+    void WaitBackgroundTasks()
+    {
+        _backgroundTasks.Wait();
+    }
+
+    // thread safe.  Index buffers and adjacency shared between meshes.
+    HdOSPRayTopologyRegistry& GetTopologyRegistry()
+    {
+        return _topologyRegistry;
+    }
+
 private:
     // mutex over ospray calls to the global model and global instances. OSPRay
     // is not thread safe
@@ -127,12 +341,33 @@ private:
     std::unordered_map<SdfPath, const HdOSPRayLight*, SdfPath::Hash>
            _hdOSPRayLights;
 
+    // renderer material list, meshes reference materials by index
+    std::mutex _materialMutex;
+    std::vector<opp::Material> _materials;
+    std::unordered_map<SdfPath, uint32_t, SdfPath::Hash> _materialIndices;
+
     std::vector<const HdOSPRayMesh*> _hdOSPRayMeshes;
+    std::unordered_map<const HdOSPRayMesh*, size_t> _hdOSPRayMeshIndices;
     std::vector<const HdOSPRayBasisCurves*> _hdOSPRayBasisCurves;
 
+    // adaptive subdivision levels, written by the render pass
+    std::mutex _subdivisionMutex;
+    std::unordered_map<SdfPath, int, SdfPath::Hash> _subdivisionLevels;
+
+    HdOSPRayTopologyRegistry _topologyRegistry;
+    HdOSPRayMeshBatcher _meshBatcher;
+
     opp::Renderer _renderer;
     /// A version counters for edits to scene (e.g., models or lights).
     std::atomic<int> _modelVersion { 1 };
+    std::atomic<int> _instanceVersion { 1 };
     std::atomic<int> _lightVersion { 1 };
     std::atomic<int> _materialVersion { 1 };
+    std::atomic<int> _materialListVersion { 1 };
+    std::atomic<int> _proxyVersion { 1 };
+    std::shared_ptr<HdOSPRayTextureUpdates> _textureUpdates {
+        std::make_shared<HdOSPRayTextureUpdates>()
+    };
+    // texture decodes and mesh proxy builds in flight
+    WorkDispatcher _backgroundTasks;
 };
\ No newline at end of file
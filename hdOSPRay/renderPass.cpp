@@ -14,6 +14,7 @@
 
 #include <pxr/imaging/hd/camera.h>
 #include <pxr/imaging/hd/perfLog.h>
+#include <pxr/imaging/hd/renderIndex.h>
 #include <pxr/imaging/hd/renderPassState.h>
 
 #include <pxr/base/gf/vec2f.h>
@@ -21,7 +22,9 @@
 
 #include <ospray/ospray_util.h>
 
+#include <algorithm>
 #include <iostream>
+#include <limits>
 
 using namespace rkcommon::math;
 
@@ -56,6 +59,12 @@ HdOSPRayRenderPass::HdOSPRayRenderPass(
     , _elementIdBuffer(SdfPath::EmptyPath())
     , _instIdBuffer(SdfPath::EmptyPath())
 {
+    _meshBatching = HdOSPRayConfig::GetInstance().meshBatching;
+    _adaptiveSubdivision = HdOSPRayConfig::GetInstance().adaptiveSubdivision;
+    _interactiveProxies = HdOSPRayConfig::GetInstance().interactiveProxies;
+    _releaseHiddenSeconds = HdOSPRayConfig::GetInstance().releaseHiddenSeconds;
+    _interactiveStrandFraction
+           = HdOSPRayConfig::GetInstance().interactiveStrandFraction;
     _world = opp::World();
     _world.setParam("dynamicScene", true);
     _camera = opp::Camera("perspective");
@@ -95,8 +104,10 @@ HdOSPRayRenderPass::ResetImage()
 bool
 HdOSPRayRenderPass::IsConverged() const
 {
+    // textures still decoding in the background will change the image
     return ((unsigned int)_numSamplesAccumulated
-            >= (unsigned int)_samplesToConvergence);
+            >= (unsigned int)_samplesToConvergence)
+           && !_renderParam->IsLoadingTextures();
 }
 
 void
@@ -142,6 +153,10 @@ HdOSPRayRenderPass::_Execute(HdRenderPassStateSharedPtr const& renderPassState,
         _lastSettingsVersion = currentSettingsVersion;
     }
 
+    // textures decoded in the background update their materials, which
+    // bumps the material version
+    _renderParam->ApplyTextureUpdates();
+
     if (!HdOSPRayConfig::GetInstance().usePathTracing) {
         _interactiveFrameBufferScale = 1.0f;
         _newInteractiveFrameBufferScale = 1.0f;
@@ -234,12 +249,34 @@ HdOSPRayRenderPass::_Execute(HdRenderPassStateSharedPtr const& renderPassState,
         cameraDirty = true;
     }
 
+    // instances updated in place keep the instance lists, the worlds only
+    // need to be recommitted
+    bool instancesMoved = false;
+    int currentInstanceVersion = _renderParam->GetInstanceVersion();
+    if (_lastRenderedInstanceVersion != currentInstanceVersion) {
+        _lastRenderedInstanceVersion = currentInstanceVersion;
+        instancesMoved = true;
+        // proxies follow the instances by rebuilding their own
+        _pendingProxyUpdate |= _UsesProxyWorld();
+        cameraDirty = true;
+    }
+
     int currentMaterialVersion = _renderParam->GetMaterialVersion();
     if (_lastRenderedMaterialVersion != currentMaterialVersion) {
         _lastRenderedMaterialVersion = currentMaterialVersion;
         cameraDirty = true;
     }
 
+    // geometric models reference materials by index into this list
+    int currentMaterialListVersion = _renderParam->GetMaterialListVersion();
+    if (_lastMaterialListVersion != currentMaterialListVersion) {
+        _lastMaterialListVersion = currentMaterialListVersion;
+        _renderer.setParam("material",
+                           opp::CopiedData(_renderParam->GetMaterialList()));
+        _rendererDirty = true;
+        cameraDirty = true;
+    }
+
     // dirty lights
     int currentLightVersion = _renderParam->GetLightVersion();
     if (_lastRenderedLightVersion != currentLightVersion) {
@@ -248,8 +285,28 @@ HdOSPRayRenderPass::_Execute(HdRenderPassStateSharedPtr const& renderPassState,
         cameraDirty = true;
     }
 
+    // proxies finished in the background only change the proxy world, the
+    // accumulated image is not affected
+    if (_interactiveProxies) {
+        int currentProxyVersion = _renderParam->GetProxyVersion();
+        if (_lastProxyVersion != currentProxyVersion) {
+            _pendingProxyUpdate = true;
+            _lastProxyVersion = currentProxyVersion;
+        }
+    }
+
+    // worlds are built per combination of render tags and collection, the
+    // last few are kept to make toggling purposes cheap
+    bool worldSwitched = false;
+    _WorldFilter worldFilter = _ComputeWorldFilter(renderTags);
+    if (!(worldFilter == _worldFilter)) {
+        _SwitchWorld(std::move(worldFilter));
+        worldSwitched = true;
+        cameraDirty = true;
+    }
+
     // if we need to recommit the world
-    bool worldDirty = _pendingModelUpdate;
+    bool worldDirty = _pendingModelUpdate || worldSwitched || instancesMoved;
     bool lightsDirty = _pendingLightUpdate;
 
     _pendingResetImage |= (_pendingModelUpdate || _pendingLightUpdate);
@@ -355,10 +412,22 @@ HdOSPRayRenderPass::_Execute(HdRenderPassStateSharedPtr const& renderPassState,
         _currentFrameBufferScale = 1.0f;
     }
 
+    // pick subdivision levels once the camera has settled.  Changed meshes are
+    // retessellated in the next sync.
+    if (_adaptiveSubdivision && _subdivisionLevelsDirty && !_interacting)
+        _UpdateSubdivisionLevels();
+
+    if (_releaseHiddenSeconds > 0)
+        _ReleaseHiddenMeshes();
+
     // add mesh instances to world
     if (_pendingModelUpdate) {
         _ProcessInstances();
     }
+    bool proxyWorldDirty = _pendingProxyUpdate;
+    if (_pendingProxyUpdate) {
+        _ProcessProxyInstances();
+    }
 
     // add lights to world
     if (_pendingLightUpdate) {
@@ -372,6 +441,9 @@ HdOSPRayRenderPass::_Execute(HdRenderPassStateSharedPtr const& renderPassState,
         //   you cannot just update the lights group
         _world.commit();
     }
+    if (_proxyWorld && (proxyWorldDirty || lightsDirty)) {
+        _proxyWorld.commit();
+    }
 
     // Reset the sample buffer if it's been requested.
     if (_pendingResetImage) {
@@ -401,10 +473,17 @@ HdOSPRayRenderPass::_Execute(HdRenderPassStateSharedPtr const& renderPassState,
     if (_interacting)
         frameBuffer = _interactiveFrameBuffer;
 
+    // heavy meshes and dense curves are replaced by their proxies while
+    // interacting
+    opp::World world = _world;
+    if (_interacting && _numProxies > 0)
+        world = _proxyWorld;
+
     // Async render the frame.
-    if (!IsConverged()) {
+    if ((unsigned int)_numSamplesAccumulated
+        < (unsigned int)_samplesToConvergence) {
         _currentFrame.osprayFrame
-               = frameBuffer.renderFrame(_renderer, _camera, _world);
+               = frameBuffer.renderFrame(_renderer, _camera, world);
         if (_interacting) {
             _currentFrame.osprayFrame.wait();
             _CopyFrameBuffer(renderPassState);
@@ -532,6 +611,12 @@ HdOSPRayRenderPass::_ProcessCamera(
     renderPassState->GetProjectionMatrix().Get(prjMatrix);
     float fov = 2.0 * std::atan(1.0 / prjMatrix[1][1]) * 180.0 / M_PI;
 
+    // pixels per world unit at distance 1 (perspective) or anywhere
+    // (orthographic), used for adaptive subdivision
+    _projectionScale = prjMatrix[1][1] * _height * 0.5;
+    _orthographic = prjMatrix[3][3] == 1.0;
+    _subdivisionLevelsDirty = true;
+
     float focusDistance = 3.96f;
     float focalLength = 8.f;
     float fStop = 0.f;
@@ -572,6 +657,113 @@ HdOSPRayRenderPass::_ProcessCamera(
     TF_DEBUG_MSG(OSP, "fovy: %f\n", fov);
 }
 
+float
+HdOSPRayRenderPass::_ComputeProjectedSize(const GfRange3d& bounds) const
+{
+    if (bounds.IsEmpty())
+        return 0.f;
+    const double radius = 0.5 * bounds.GetSize().GetLength();
+    if (_orthographic)
+        return 2.0 * radius * _projectionScale;
+    const double distance
+           = (bounds.GetMidpoint() - GfVec3d(_cameraOrigin)).GetLength()
+           - radius;
+    if (distance <= 0.0)
+        return std::numeric_limits<float>::max();
+    return 2.0 * radius / distance * _projectionScale;
+}
+
+void
+HdOSPRayRenderPass::_ReleaseHiddenMeshes()
+{
+    // hidden prims are not synced, checking about once a second is plenty
+    const auto now = std::chrono::steady_clock::now();
+    if (now - _lastHiddenCheck < std::chrono::seconds(1))
+        return;
+    _lastHiddenCheck = now;
+
+    // meshes hidden for long release their objects in the next sync
+    HdChangeTracker& changeTracker = GetRenderIndex()->GetChangeTracker();
+    for (const HdOSPRayMesh* mesh : _renderParam->GetHdOSPRayMeshes()) {
+        if (mesh->IsHiddenLongerThan(_releaseHiddenSeconds)) {
+            changeTracker.MarkRprimDirty(mesh->GetId(),
+                                         HdChangeTracker::DirtyVisibility);
+        }
+    }
+}
+
+void
+HdOSPRayRenderPass::_UpdateSubdivisionLevels()
+{
+    _subdivisionLevelsDirty = false;
+
+    const HdOSPRayConfig& config = HdOSPRayConfig::GetInstance();
+    const float edgePixels = std::max(1, config.subdivisionEdgePixels);
+    const double budget = std::max(1, config.subdivisionBudget) * 1.0e6;
+
+    struct Candidate {
+        const HdOSPRayMesh* mesh;
+        double numFaces;
+        int level;
+    };
+    std::vector<Candidate> candidates;
+    double numQuads = 0.0;
+    for (const HdOSPRayMesh* mesh : _renderParam->GetHdOSPRayMeshes()) {
+        if (!mesh->IsAdaptiveSubdivisionCandidate())
+            continue;
+        const double numFaces
+               = std::max(size_t(1), mesh->GetNumCoarseFaces());
+        // tessellated edges should span about edgePixels on screen
+        const float idealLevel
+               = _ComputeProjectedSize(mesh->GetWorldBounds())
+               / std::sqrt(numFaces) / edgePixels;
+        int level = mesh->GetTessellationRate();
+        // hysteresis: levels are powers of two and only change once the
+        // ideal level is a full power of two away from the current one
+        if (idealLevel >= 2.f * level || idealLevel <= 0.5f * level) {
+            level = 1 << std::min(
+                           30, int(std::round(std::log2(
+                                      std::max(1.f, idealLevel)))));
+        }
+        level = std::max(int(HdOSPRayMesh::MinTessellationRate),
+                         std::min(mesh->GetMaxTessellationRate(), level));
+        candidates.push_back({ mesh, numFaces, level });
+        numQuads += numFaces * level * level;
+    }
+
+    // over budget, coarsen the finest tessellated prims first
+    while (numQuads > budget) {
+        int finestLevel = 0;
+        for (const Candidate& candidate : candidates)
+            finestLevel = std::max(finestLevel, candidate.level);
+        if (finestLevel <= HdOSPRayMesh::MinTessellationRate)
+            break;
+        for (Candidate& candidate : candidates) {
+            if (candidate.level != finestLevel)
+                continue;
+            const int level = candidate.level / 2;
+            numQuads -= candidate.numFaces
+                   * (candidate.level * candidate.level - level * level);
+            candidate.level = level;
+        }
+    }
+
+    HdChangeTracker& changeTracker = GetRenderIndex()->GetChangeTracker();
+    size_t numChanged = 0;
+    for (const Candidate& candidate : candidates) {
+        if (candidate.level == candidate.mesh->GetTessellationRate())
+            continue;
+        const SdfPath& id = candidate.mesh->GetId();
+        _renderParam->SetSubdivisionLevel(id, candidate.level);
+        changeTracker.MarkRprimDirty(id, HdChangeTracker::DirtyDisplayStyle);
+        numChanged++;
+    }
+    TF_DEBUG_MSG(OSP,
+                 "ospRP::adaptive subdivision: %zu of %zu meshes changed, "
+                 "%.2fM quads\n",
+                 numChanged, candidates.size(), numQuads * 1.0e-6);
+}
+
 void
 HdOSPRayRenderPass::_ProcessLights()
 {
@@ -661,6 +853,17 @@ HdOSPRayRenderPass::_ProcessSettings()
            _interactiveTargetFPS);
     _interactiveEnabled = (_interactiveTargetFPS != 0);
 
+    // strand subsets are only rendered while interacting, so they are tied
+    // to the interactive scaling being enabled
+    const bool usedProxyWorld = bool(_proxyWorld);
+    float strandFraction = renderDelegate->GetRenderSetting<float>(
+           HdOSPRayRenderSettingsTokens->interactiveStrandFraction,
+           _interactiveStrandFraction);
+    _interactiveStrandFraction = std::min(1.f, std::max(.01f, strandFraction));
+    if (_interactiveStrandFraction != _proxyStrandFraction
+        || usedProxyWorld != _UsesProxyWorld())
+        _pendingProxyUpdate = true;
+
     if (samplesToConvergence != _samplesToConvergence) {
         _samplesToConvergence = samplesToConvergence;
         _pendingResetImage = true;
@@ -720,19 +923,124 @@ HdOSPRayRenderPass::_ProcessSettings()
     }
 }
 
+bool
+HdOSPRayRenderPass::_WorldFilter::operator==(const _WorldFilter& other) const
+{
+    return renderTags == other.renderTags && rootPaths == other.rootPaths
+           && excludePaths == other.excludePaths;
+}
+
+bool
+HdOSPRayRenderPass::_WorldFilter::Accepts(SdfPath const& id,
+                                          TfToken const& renderTag) const
+{
+    if (!renderTags.empty()
+        && !std::binary_search(renderTags.begin(), renderTags.end(),
+                               renderTag))
+        return false;
+    for (SdfPath const& path : excludePaths) {
+        if (id.HasPrefix(path))
+            return false;
+    }
+    for (SdfPath const& path : rootPaths) {
+        if (id.HasPrefix(path))
+            return true;
+    }
+    return false;
+}
+
+HdOSPRayRenderPass::_WorldFilter
+HdOSPRayRenderPass::_ComputeWorldFilter(TfTokenVector const& renderTags) const
+{
+    _WorldFilter filter;
+    filter.renderTags = renderTags;
+    std::sort(filter.renderTags.begin(), filter.renderTags.end());
+    const HdRprimCollection& collection = GetRprimCollection();
+    filter.rootPaths = collection.GetRootPaths();
+    filter.excludePaths = collection.GetExcludePaths();
+    return filter;
+}
+
 void
-HdOSPRayRenderPass::_ProcessInstances()
+HdOSPRayRenderPass::_SwitchWorld(_WorldFilter filter)
 {
-    // release resources from last committed scene
-    _oldInstances.resize(0);
-    // create new model and populate with mesh instances
+    // keep the current world around for switching back
+    if (_worldModelVersion >= 0) {
+        _cachedWorlds.push_back(
+               { std::move(_worldFilter), _world, _worldModelVersion });
+    }
+    _worldFilter = std::move(filter);
+
+    auto it = std::find_if(_cachedWorlds.begin(), _cachedWorlds.end(),
+                           [this](const _CachedWorld& cached) {
+                               return cached.filter == _worldFilter;
+                           });
+    if (it != _cachedWorlds.end() && !_pendingModelUpdate
+        && it->modelVersion == _lastRenderedModelVersion) {
+        _world = it->world;
+        _worldModelVersion = it->modelVersion;
+    } else {
+        _world = opp::World();
+        _world.setParam("dynamicScene", true);
+        _worldModelVersion = -1;
+        _pendingModelUpdate = true;
+    }
+    if (it != _cachedWorlds.end())
+        _cachedWorlds.erase(it);
+    if (_cachedWorlds.size() > MaxCachedWorlds)
+        _cachedWorlds.erase(_cachedWorlds.begin());
+    _pendingProxyUpdate = _UsesProxyWorld();
+    TF_DEBUG_MSG(OSP, "ospRP::switched world, %s\n",
+                 _pendingModelUpdate ? "rebuilding" : "cached");
+}
+
+size_t
+HdOSPRayRenderPass::_CollectInstances(std::vector<opp::Instance>& instances,
+                                      bool useProxies)
+{
+    auto accept = [this](const HdOSPRayMesh* mesh) {
+        return _worldFilter.Accepts(mesh->GetId(), mesh->GetSyncedRenderTag());
+    };
+    size_t numProxies = 0;
+    // batches with rejected meshes are split into their accepted meshes
+    std::vector<const HdOSPRayMesh*> splitMeshes;
+    HdOSPRayMeshBatcher& batcher = _renderParam->GetMeshBatcher();
+    if (_meshBatching)
+        batcher.AddOSPInstances(instances, accept, splitMeshes);
     for (auto hdOSPRayMesh : _renderParam->GetHdOSPRayMeshes()) {
-        hdOSPRayMesh->AddOSPInstances(_oldInstances);
+        if (_meshBatching && batcher.IsBatched(hdOSPRayMesh))
+            continue;
+        if (accept(hdOSPRayMesh)
+            && hdOSPRayMesh->AddOSPInstances(instances, useProxies))
+            numProxies++;
+    }
+    for (auto hdOSPRayMesh : splitMeshes) {
+        if (hdOSPRayMesh->AddOSPInstances(instances, useProxies))
+            numProxies++;
     }
+    const float strandFraction
+           = useProxies ? _interactiveStrandFraction : 1.f;
     for (auto hdOSPRayBasisCurves : _renderParam->GetHdOSPRayBasisCurves()) {
-        hdOSPRayBasisCurves->AddOSPInstances(_oldInstances);
+        if (_worldFilter.Accepts(hdOSPRayBasisCurves->GetId(),
+                                 hdOSPRayBasisCurves->GetSyncedRenderTag())
+            && hdOSPRayBasisCurves->AddOSPInstances(instances,
+                                                    strandFraction))
+            numProxies++;
     }
-    _oldInstances.emplace_back(_lightsInstance);
+    instances.emplace_back(_lightsInstance);
+    return numProxies;
+}
+
+void
+HdOSPRayRenderPass::_ProcessInstances()
+{
+    // release resources from last committed scene
+    _oldInstances.resize(0);
+    // merge small static meshes, the rest are added as their own instances
+    if (_meshBatching)
+        _renderParam->GetMeshBatcher().Update(_renderParam->GetHdOSPRayMeshes());
+    // create new model and populate with the instances passing the filter
+    _CollectInstances(_oldInstances, false);
     TF_DEBUG_MSG(OSP, "ospRP::num instances %zu\n", _oldInstances.size());
     if (!_oldInstances.empty()) {
         opp::CopiedData data = opp::CopiedData(
@@ -742,7 +1050,39 @@ HdOSPRayRenderPass::_ProcessInstances()
     } else {
         _world.removeParam("instance");
     }
+    _worldModelVersion = _lastRenderedModelVersion;
     _pendingModelUpdate = false;
+    _pendingProxyUpdate = _UsesProxyWorld();
+}
+
+bool
+HdOSPRayRenderPass::_UsesProxyWorld() const
+{
+    return _interactiveProxies
+           || (_interactiveEnabled && _interactiveStrandFraction < 1.f);
+}
+
+void
+HdOSPRayRenderPass::_ProcessProxyInstances()
+{
+    _pendingProxyUpdate = false;
+    _proxyStrandFraction = _interactiveStrandFraction;
+    _proxyInstances.resize(0);
+    if (!_UsesProxyWorld()) {
+        _proxyWorld = nullptr;
+        _numProxies = 0;
+        return;
+    }
+    if (!_proxyWorld) {
+        _proxyWorld = opp::World();
+        _proxyWorld.setParam("dynamicScene", true);
+    }
+    _numProxies = _CollectInstances(_proxyInstances, true);
+    TF_DEBUG_MSG(OSP, "ospRP::num proxies %zu\n", _numProxies);
+    opp::CopiedData data = opp::CopiedData(
+           _proxyInstances.data(), OSP_INSTANCE, _proxyInstances.size());
+    data.commit();
+    _proxyWorld.setParam("instance", data);
 }
 
 void
@@ -857,7 +1197,7 @@ HdOSPRayRenderPass::_CopyFrameBuffer(
             frameBuffer.unmap(normal);
         }
 
-        if (_hasPrimId) {
+        if (_NeedObjectIds()) {
             unsigned int* primId = static_cast<unsigned int*>(
                    frameBuffer.map(OSP_FB_ID_OBJECT));
             if (primId)
@@ -866,7 +1206,7 @@ HdOSPRayRenderPass::_CopyFrameBuffer(
             frameBuffer.unmap(primId);
         }
 
-        if (_hasElementId) {
+        if (_NeedPrimitiveIds()) {
             unsigned int* geomId = static_cast<unsigned int*>(
                    frameBuffer.map(OSP_FB_ID_PRIMITIVE));
             if (geomId)
@@ -875,6 +1215,20 @@ HdOSPRayRenderPass::_CopyFrameBuffer(
             frameBuffer.unmap(geomId);
         }
 
+        // map merged geometry ids back to source prims
+        if (_meshBatching && (_hasPrimId || _hasElementId)) {
+            const HdOSPRayMeshBatcher& batcher
+                   = _renderParam->GetMeshBatcher();
+            tbb::parallel_for(tbb::blocked_range<int>(0, frameSize),
+                              [&](tbb::blocked_range<int> r) {
+                                  for (int i = r.begin(); i < r.end(); ++i) {
+                                      batcher.ResolveIds(
+                                             _currentFrame.primIdBuffer[i],
+                                             _currentFrame.elementIdBuffer[i]);
+                                  }
+                              });
+        }
+
         if (_hasInstId) {
             unsigned int* instId = static_cast<unsigned int*>(
                    frameBuffer.map(OSP_FB_ID_INSTANCE));
@@ -896,8 +1250,8 @@ HdOSPRayRenderPass::_UpdateFrameBuffer(
                (_hasColor ? OSP_FB_COLOR : 0)
                       | (_hasDepth || _hasCameraDepth ? OSP_FB_DEPTH : 0)
                       | (_hasNormal ? OSP_FB_NORMAL : 0)
-                      | (_hasElementId ? OSP_FB_ID_PRIMITIVE : 0)
-                      | (_hasPrimId ? OSP_FB_ID_OBJECT : 0)
+                      | (_NeedPrimitiveIds() ? OSP_FB_ID_PRIMITIVE : 0)
+                      | (_NeedObjectIds() ? OSP_FB_ID_OBJECT : 0)
                       | (_hasInstId ? OSP_FB_ID_INSTANCE : 0) | OSP_FB_ACCUM |
 #if HDOSPRAY_ENABLE_DENOISER
                       OSP_FB_ALBEDO | OSP_FB_VARIANCE | OSP_FB_NORMAL
@@ -956,8 +1310,8 @@ HdOSPRayRenderPass::_UpdateFrameBuffer(
                (_hasColor ? OSP_FB_COLOR : 0)
                       | (_hasDepth || _hasCameraDepth ? OSP_FB_DEPTH : 0)
                       | (_hasNormal ? OSP_FB_NORMAL : 0)
-                      | (_hasElementId ? OSP_FB_ID_PRIMITIVE : 0)
-                      | (_hasPrimId ? OSP_FB_ID_OBJECT : 0)
+                      | (_NeedPrimitiveIds() ? OSP_FB_ID_PRIMITIVE : 0)
+                      | (_NeedObjectIds() ? OSP_FB_ID_OBJECT : 0)
                       | (_hasInstId ? OSP_FB_ID_INSTANCE : 0));
         _interactiveFrameBuffer.commit();
         _interactiveFrameBufferDirty = false;
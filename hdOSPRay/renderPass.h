@@ -6,6 +6,7 @@
 #include "renderBuffer.h"
 
 #include <pxr/base/gf/matrix4d.h>
+#include <pxr/base/gf/range3d.h>
 #include <pxr/base/tf/debug.h>
 #include <pxr/imaging/hd/renderPass.h>
 #include <pxr/pxr.h>
@@ -18,6 +19,8 @@
 
 #include "config.h"
 
+#include <chrono>
+
 namespace opp = ospray::cpp;
 
 using namespace rkcommon::math;
@@ -101,6 +104,15 @@ protected:
     virtual void _ProcessLights();
     virtual void _ProcessSettings();
     virtual void _ProcessInstances();
+    /// Whether mesh proxies or strand subsets are rendered while interacting
+    bool _UsesProxyWorld() const;
+    /// Populate the proxy world from the instances of _ProcessInstances
+    void _ProcessProxyInstances();
+    /// Pick subdivision levels of refined meshes from their projected size
+    void _UpdateSubdivisionLevels();
+    /// Let meshes hidden for longer than HDOSPRAY_RELEASE_HIDDEN_SECONDS
+    /// release their OSPRay objects
+    void _ReleaseHiddenMeshes();
     virtual void
     _CopyFrameBuffer(HdRenderPassStateSharedPtr const& renderPassState);
     virtual void _DisplayRenderBuffer(RenderFrame& renderFrame);
@@ -141,6 +153,9 @@ private:
             TF_WARN("displayrenderbuffer size out of sync");
     };
 
+    // Projected diameter of bounds in pixels
+    float _ComputeProjectedSize(const GfRange3d& bounds) const;
+
     // Return the clear color to use for the given VtValue
     static GfVec4f _ComputeClearColor(VtValue const& clearValue);
 
@@ -148,6 +163,44 @@ private:
     void _UpdateFrameBuffer(bool useDenoiser,
                             HdRenderPassStateSharedPtr const& renderPassState);
 
+    // render tags and collection paths selecting the rprims of a world
+    struct _WorldFilter {
+        TfTokenVector renderTags; // sorted, empty accepts all tags
+        SdfPathVector rootPaths;
+        SdfPathVector excludePaths;
+
+        bool operator==(const _WorldFilter& other) const;
+        bool Accepts(SdfPath const& id, TfToken const& renderTag) const;
+    };
+
+    // world of a previously active filter, reused while the scene is
+    // unchanged
+    struct _CachedWorld {
+        _WorldFilter filter;
+        opp::World world;
+        int modelVersion;
+    };
+
+    static constexpr size_t MaxCachedWorlds = 4;
+
+    _WorldFilter _ComputeWorldFilter(TfTokenVector const& renderTags) const;
+    /// Make the world of filter current, rebuilding it unless cached
+    void _SwitchWorld(_WorldFilter filter);
+    /// Add the instances of all rprims accepted by the current filter.
+    /// Returns the number of meshes added as proxies.
+    size_t _CollectInstances(std::vector<opp::Instance>& instances,
+                             bool useProxies);
+
+    bool _NeedObjectIds() const
+    {
+        return _hasPrimId || (_meshBatching && _hasElementId);
+    }
+
+    bool _NeedPrimitiveIds() const
+    {
+        return _hasElementId || (_meshBatching && _hasPrimId);
+    }
+
     bool _pendingResetImage { true };
     bool _interactiveFrameBufferDirty { true };
     bool _frameBufferDirty { true };
@@ -176,6 +229,8 @@ private:
     bool _hasElementId { false };
     HdOSPRayRenderBuffer _instIdBuffer;
     bool _hasInstId { false };
+    // batched meshes need object and primitive ids to resolve either aov
+    bool _meshBatching { false };
     float _currentFrameBufferScale { 1.0f };
     float _interactiveFrameBufferScale { 2.0f };
     float _newInteractiveFrameBufferScale {
@@ -191,8 +246,10 @@ private:
     bool _interactiveEnabled { true}; // disabled by setting interactivetargetfps to 0
 
     int _lastRenderedModelVersion { -1 };
+    int _lastRenderedInstanceVersion { -1 };
     int _lastRenderedLightVersion { -1 };
     int _lastRenderedMaterialVersion { -1 };
+    int _lastMaterialListVersion { -1 };
     int _lastSettingsVersion { -1 };
 
     RenderFrame _currentFrame;
@@ -205,6 +262,20 @@ private:
     opp::Camera _camera;
     GfVec3f _cameraDir { 0.f, 0.f, -1.f };
     GfVec3f _cameraOrigin { 0.f, 0.f, 1.f };
+    double _projectionScale { 1.0 };
+    bool _orthographic { false };
+
+    bool _adaptiveSubdivision { false };
+    bool _interactiveProxies { false };
+    // fraction of the strands of dense curves rendered while interacting
+    float _interactiveStrandFraction { 1.f };
+    // fraction the proxy world was built for
+    float _proxyStrandFraction { 1.f };
+    bool _pendingProxyUpdate { false };
+    int _lastProxyVersion { -1 };
+    int _releaseHiddenSeconds { 0 };
+    std::chrono::steady_clock::time_point _lastHiddenCheck;
+    bool _subdivisionLevelsDirty { true };
 
     // camera space to world space
     GfMatrix4d _inverseViewMatrix;
@@ -218,6 +289,14 @@ private:
     opp::Group _lightsGroup;
     opp::Instance _lightsInstance;
     opp::World _world = nullptr; // the last model created
+    _WorldFilter _worldFilter;
+    int _worldModelVersion { -1 }; // model version _world was built for
+    std::vector<_CachedWorld> _cachedWorlds;
+    // _world with heavy meshes replaced by their decimated proxies and dense
+    // curves by strand subsets, rendered while interacting
+    std::vector<opp::Instance> _proxyInstances;
+    opp::World _proxyWorld = nullptr;
+    size_t _numProxies { 0 };
 
     int _numSamplesAccumulated { 0 }; // number of rendered frames not cleared
     int _spp { HDOSPRAY_DEFAULT_SPP };
@@ -11,6 +11,7 @@
 #include <pxr/imaging/hd/rendererPluginRegistry.h>
 #include "config.h"
 #include "renderDelegate.h"
+#include "textureCache.h"
 
 #ifdef WIN32
 // TF_REGISTER does not seem to work correctly for external plugins on Windows.
@@ -104,6 +105,8 @@ void
 HdOSPRayRendererPlugin::DeleteRenderDelegate(HdRenderDelegate* renderDelegate)
 {
     delete renderDelegate;
+    // cached textures hold OSPRay objects
+    HdOSPRayTextureCache::GetInstance().Clear();
     ospShutdown();
 }
 
@@ -4,6 +4,11 @@
 #include "texture.h"
 #include "config.h"
 
+#include <pxr/base/arch/fileSystem.h>
+#include <pxr/base/tf/fileUtils.h>
+#include <pxr/base/tf/pathUtils.h>
+#include <pxr/base/tf/stringUtils.h>
+#include <pxr/base/work/loops.h>
 #include <pxr/imaging/hd/tokens.h>
 #include <pxr/imaging/hio/image.h>
 #include <pxr/usd/ar/resolver.h>
@@ -11,6 +16,15 @@
 
 #include <rkcommon/math/vec.h>
 
+#include <algorithm>
+#include <cctype>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
 using namespace rkcommon::math;
 
 OSPTextureFormat
@@ -58,21 +72,10 @@ LoadPtexTexture(std::string file)
     return ospTexture;
 }
 
-static std::map<std::string, HdOSPRayTexture*> _mapHio;
-
 HdOSPRayTexture
 LoadHioTexture2D(const std::string file, const std::string channelsStr,
                  bool nearestFilter, bool complement)
 {
-    // check texture and params for cached texture
-    // TODO: when to delete texture cache?
-    std::stringstream ss;
-    ss << file << ":" << channelsStr << ":" << nearestFilter << ":" << complement;
-    const std::string key = ss.str();
-    auto cache = _mapHio[key];
-    if (cache)
-        return *cache;
-
     const auto image = HioImage::OpenForReading(file);
     if (!image) {
         TF_DEBUG_MSG(OSP, "#osp: failed to open texture \"%s\"\n",
@@ -261,17 +264,87 @@ LoadHioTexture2D(const std::string file, const std::string channelsStr,
            = std::shared_ptr<uint8_t>(data, std::default_delete<uint8_t[]>());
     auto outDataPtr = std::shared_ptr<uint8_t>(
            outData, std::default_delete<uint8_t[]>());
-    HdOSPRayTexture* result = new HdOSPRayTexture(std::move(ospTexture),
+    HdOSPRayTexture result(std::move(ospTexture),
                            outData ? outDataPtr : dataPtr);
-    _mapHio[key] = result;
-    return *result;
+    result.bytes = size_t(size.x) * size.y
+           * (outData ? outChannels * outDepth : channels * depth);
+    return result;
 }
 
-struct UDIMTileDesc {
-    uint8_t* data;
-    vec2i size { 0, 0 };
-    int offset { -1 };
+// tiles of UDIM patterns listed from their directory, valid as long as the
+// modification time of the directory is unchanged
+struct _UDIMListing {
+    double modificationTime { 0.0 };
+    std::vector<std::tuple<int, TfToken>> tiles;
 };
+static std::mutex _udimListingMutex;
+static std::unordered_map<std::string, _UDIMListing> _udimListings;
+
+/// Tiles of a UDIM pattern from a single listing of the local directory
+/// holding them.  Returns false if the pattern is not a path into a
+/// directory that can be listed.
+static bool
+_ListUDIMTiles(const std::string& prefix, const std::string& suffix,
+               std::vector<std::tuple<int, TfToken>>* result)
+{
+    // only resolved patterns with <UDIM> in the file name, not in a
+    // directory name
+    const std::string dir = TfGetPathName(prefix);
+    if (dir.empty() || TfIsRelativePath(dir)
+        || suffix.find_first_of("/\\") != std::string::npos)
+        return false;
+    double modificationTime = 0.0;
+    if (!ArchGetModificationTime(dir.c_str(), &modificationTime))
+        return false;
+
+    const std::string pattern = prefix + "<UDIM>" + suffix;
+    {
+        std::lock_guard<std::mutex> lock(_udimListingMutex);
+        auto it = _udimListings.find(pattern);
+        if (it != _udimListings.end()
+            && it->second.modificationTime == modificationTime) {
+            *result = it->second.tiles;
+            return true;
+        }
+    }
+
+    std::vector<std::string> files, links;
+    std::string error;
+    if (!TfReadDir(dir, nullptr, &files, &links, &error)) {
+        TF_DEBUG_MSG(OSP, "#osp: failed to list UDIM directory \"%s\": %s\n",
+                     dir.c_str(), error.c_str());
+        return false;
+    }
+    files.insert(files.end(), links.begin(), links.end());
+
+    const std::string namePrefix = prefix.substr(dir.size());
+    _UDIMListing listing;
+    listing.modificationTime = modificationTime;
+    for (const std::string& file : files) {
+        if (file.size() != namePrefix.size() + 4 + suffix.size()
+            || !TfStringStartsWith(file, namePrefix)
+            || !TfStringEndsWith(file, suffix))
+            continue;
+        const std::string digits = file.substr(namePrefix.size(), 4);
+        if (!std::all_of(digits.begin(), digits.end(), [](char c) {
+                return std::isdigit(static_cast<unsigned char>(c));
+            }))
+            continue;
+        const int tile = std::stoi(digits);
+        if (tile >= 1001 && tile < 1100)
+            listing.tiles.emplace_back(tile - 1001, TfToken(dir + file));
+    }
+    std::sort(listing.tiles.begin(), listing.tiles.end(),
+              [](std::tuple<int, TfToken> const& a,
+                 std::tuple<int, TfToken> const& b) {
+                  return std::get<0>(a) < std::get<0>(b);
+              });
+
+    *result = listing.tiles;
+    std::lock_guard<std::mutex> lock(_udimListingMutex);
+    _udimListings[pattern] = std::move(listing);
+    return true;
+}
 
 /// UDIM helper, splits udim filepath into individual tile files
 /// @param filePath Udim filepath of form ...<UDIM>...
@@ -292,6 +365,11 @@ _ParseUDIMTiles(const std::string& filePath)
         return result;
     }
 
+    // patterns resolved to local or network file system paths are listed
+    // once instead of resolving all possible tiles
+    if (_ListUDIMTiles(splitPath.first, splitPath.second, &result))
+        return result;
+
     ArResolver& resolver = ArGetResolver();
 
     // add file names to result
@@ -306,161 +384,181 @@ _ParseUDIMTiles(const std::string& filePath)
     return result;
 }
 
-// creates 2d osptexture from file, does not commit
+// decoded UDIM tile
+struct _UDIMTile {
+    std::unique_ptr<uint8_t[]> data;
+    vec2i size { 0, 0 };
+    size_t texelSize { 0 };
+    OSPTextureFormat format { OSP_TEXTURE_FORMAT_INVALID };
+    OSPDataType dataType { OSP_UNKNOWN };
+};
+
+/// Decode a UDIM tile, returns false if it could not be read or its format
+/// is not supported
+static bool
+_ReadUDIMTile(const std::string& file, _UDIMTile* tile)
+{
+    const auto image = HioImage::OpenForReading(file);
+    if (!image) {
+        TF_DEBUG_MSG(OSP, "#osp: failed to load texture \"%s\"\n",
+                     file.c_str());
+        return false;
+    }
+
+    HioImage::StorageSpec desc;
+    desc.format = image->GetFormat();
+    desc.width = image->GetWidth();
+    desc.height = image->GetHeight();
+    desc.depth = 1;
+    desc.flipped = true;
+    const bool srgb = image->IsColorSpaceSRGB();
+    int depth = 1;
+    if (desc.format == HioFormatFloat16 || desc.format == HioFormatFloat16Vec2
+        || desc.format == HioFormatFloat16Vec3
+        || desc.format == HioFormatFloat16Vec4
+        || desc.format == HioFormatUInt16 || desc.format == HioFormatUInt16Vec2
+        || desc.format == HioFormatUInt16Vec3
+        || desc.format == HioFormatUInt16Vec4 || desc.format == HioFormatInt16
+        || desc.format == HioFormatInt16Vec2
+        || desc.format == HioFormatInt16Vec3
+        || desc.format == HioFormatInt16Vec4)
+        depth = 2;
+    if (desc.format == HioFormatFloat32 || desc.format == HioFormatFloat32Vec2
+        || desc.format == HioFormatFloat32Vec3
+        || desc.format == HioFormatFloat32Vec4
+        || desc.format == HioFormatUInt32 || desc.format == HioFormatUInt32Vec2
+        || desc.format == HioFormatUInt32Vec3
+        || desc.format == HioFormatUInt32Vec4 || desc.format == HioFormatInt32
+        || desc.format == HioFormatInt32Vec2
+        || desc.format == HioFormatInt32Vec3
+        || desc.format == HioFormatInt32Vec4)
+        depth = 4;
+    const int channels = image->GetBytesPerPixel() / depth;
+
+    tile->format = osprayTextureFormat(depth, channels, !srgb);
+    if (tile->format == OSP_TEXTURE_R32F) {
+        tile->dataType = OSP_FLOAT;
+    } else if (tile->format == OSP_TEXTURE_RGB32F) {
+        tile->dataType = OSP_VEC3F;
+    } else if (tile->format == OSP_TEXTURE_RGBA32F) {
+        tile->dataType = OSP_VEC4F;
+    } else if ((tile->format == OSP_TEXTURE_R8)
+               || (tile->format == OSP_TEXTURE_L8)) {
+        tile->dataType = OSP_UCHAR;
+    } else if ((tile->format == OSP_TEXTURE_RGB8)
+               || (tile->format == OSP_TEXTURE_SRGB)) {
+        tile->dataType = OSP_VEC3UC;
+    } else if (tile->format == OSP_TEXTURE_RGBA8
+               || tile->format == OSP_TEXTURE_SRGBA) {
+        tile->dataType = OSP_VEC4UC;
+    } else {
+        TF_WARN("#osp: UDIM tile '%s' has unsupported texture format, "
+                "depth %d, channels %d",
+                file.c_str(), depth, channels);
+        return false;
+    }
+
+    tile->size = vec2i(desc.width, desc.height);
+    tile->texelSize = size_t(channels) * depth;
+    tile->data.reset(
+           new uint8_t[size_t(desc.width) * desc.height * tile->texelSize]);
+    desc.data = tile->data.get();
+    if (!image->Read(desc)) {
+        TF_WARN("#osp: failed to read texture '%s'", file.c_str());
+        tile->data.reset();
+        return false;
+    }
+    return true;
+}
+
 HdOSPRayTexture
-LoadUDIMTexture2D(std::string file, int& numX, int& numY, bool nearestFilter,
-                  bool complement)
+LoadUDIMTexture2D(std::string file, bool nearestFilter, bool complement)
 {
     const auto& udimTiles = _ParseUDIMTiles(file);
-    std::vector<UDIMTileDesc> udimTileDescs;
-    vec2i totalSize { 0, 0 };
-    vec2i numTiles { 0, 0 };
-    numTiles = { 0, 0 };
-    OSPDataType udimDataType = OSP_UNKNOWN;
-    size_t dataStride = 0;
-    size_t texelSize = 0;
-    OSPTextureFormat format = OSP_TEXTURE_FORMAT_INVALID;
-
-    // load tile data  TODO: parallelize
-    for (const auto& tile : udimTiles) {
-        const std::string file = std::get<1>(tile);
-        const auto image = HioImage::OpenForReading(file);
-        if (!image) {
-            TF_DEBUG_MSG(OSP, "#osp: failed to load texture \"%s\"\n",
-                         file.c_str());
-            return HdOSPRayTexture();
-        }
+    if (udimTiles.empty())
+        return HdOSPRayTexture();
 
-        HioImage::StorageSpec desc;
-        desc.format = image->GetFormat();
-        desc.width = image->GetWidth();
-        desc.height = image->GetHeight();
-        desc.depth = 1;
-        desc.flipped = true;
-        vec2i size;
-        size.x = desc.width;
-        size.y = desc.height;
-        const bool srgb = image->IsColorSpaceSRGB();
-        int depth = 1;
-        if (desc.format == HioFormatFloat16
-            || desc.format == HioFormatFloat16Vec2
-            || desc.format == HioFormatFloat16Vec3
-            || desc.format == HioFormatFloat16Vec4
-            || desc.format == HioFormatUInt16
-            || desc.format == HioFormatUInt16Vec2
-            || desc.format == HioFormatUInt16Vec3
-            || desc.format == HioFormatUInt16Vec4
-            || desc.format == HioFormatInt16
-            || desc.format == HioFormatInt16Vec2
-            || desc.format == HioFormatInt16Vec3
-            || desc.format == HioFormatInt16Vec4)
-            depth = 2;
-        if (desc.format == HioFormatFloat32
-            || desc.format == HioFormatFloat32Vec2
-            || desc.format == HioFormatFloat32Vec3
-            || desc.format == HioFormatFloat32Vec4
-            || desc.format == HioFormatUInt32
-            || desc.format == HioFormatUInt32Vec2
-            || desc.format == HioFormatUInt32Vec3
-            || desc.format == HioFormatUInt32Vec4
-            || desc.format == HioFormatInt32
-            || desc.format == HioFormatInt32Vec2
-            || desc.format == HioFormatInt32Vec3
-            || desc.format == HioFormatInt32Vec4)
-            depth = 4;
-        int channels = image->GetBytesPerPixel() / depth;
-        int texelSizeCurrent = channels * depth;
-        if ((texelSize != 0) && (texelSize != texelSizeCurrent)) {
-            TF_WARN("#osp: UDIM::texel sizes do not match");
-            // TODO: cleanup mem
-            return HdOSPRayTexture();
-        }
-        texelSize = texelSizeCurrent;
-        const size_t stride = size.x * channels * depth;
-        const size_t dataSize = sizeof(char) * size.y * stride;
-        auto* data = new uint8_t[dataSize];
-        desc.data = data;
-        dataStride = stride;
-        bool loaded = image->Read(desc);
-        if (!loaded) {
-            TF_WARN("#osp: failed to read texture '%s'", file.c_str());
+    // tiles are decoded in parallel, each into a buffer of its own
+    std::vector<_UDIMTile> tiles(udimTiles.size());
+    std::vector<char> loaded(udimTiles.size(), 0);
+    WorkParallelForN(udimTiles.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            loaded[i] = _ReadUDIMTile(std::get<1>(udimTiles[i]).GetString(),
+                                       &tiles[i]);
+    });
+
+    // the atlas only covers the range of tiles in use.  All tiles get a cell
+    // of the size of the largest one, smaller tiles are scaled up to fill
+    // their cell.
+    vec2i minTile { 10, std::numeric_limits<int>::max() };
+    vec2i maxTile { -1, -1 };
+    vec2i cellSize { 0, 0 };
+    for (size_t i = 0; i < tiles.size(); i++) {
+        if (!loaded[i])
             return HdOSPRayTexture();
-        }
-
-        format = osprayTextureFormat(depth, channels, !srgb);
-
-        OSPDataType dataType = OSP_UNKNOWN;
-        if (format == OSP_TEXTURE_R32F) {
-            dataType = OSP_FLOAT;
-        } else if (format == OSP_TEXTURE_RGB32F) {
-            dataType = OSP_VEC3F;
-        } else if (format == OSP_TEXTURE_RGBA32F) {
-            dataType = OSP_VEC4F;
-        } else if ((format == OSP_TEXTURE_R8) || (format == OSP_TEXTURE_L8)) {
-            dataType = OSP_UCHAR;
-        } else if ((format == OSP_TEXTURE_RGB8)
-                   || (format == OSP_TEXTURE_SRGB)) {
-            dataType = OSP_VEC3UC;
-        } else if (format == OSP_TEXTURE_RGBA8 || format == OSP_TEXTURE_SRGBA) {
-            dataType = OSP_VEC4UC;
-        } else {
-            std::cout << "Texture: file: " << file << "\tdepth: " << depth
-                      << "\tchannels: " << channels << "\format: " << format
-                      << std::endl;
-            throw std::runtime_error(
-                   "hdOSPRay::texture::LoadTexture2D: \
-                                         Unknown texture format");
-        }
-        if ((udimDataType != OSP_UNKNOWN) && udimDataType != dataType) {
-            TF_WARN("UDIM has inconsisntent data types");
+        if (tiles[i].texelSize != tiles[0].texelSize
+            || tiles[i].dataType != tiles[0].dataType) {
+            TF_WARN("#osp: UDIM tiles of '%s' have inconsistent data types",
+                    file.c_str());
             return HdOSPRayTexture();
         }
-        udimDataType = dataType;
-
-        UDIMTileDesc udesc;
-        udesc.size = size;
-        udesc.data = data;
-        udesc.offset = std::get<0>(tile);
-        int tileX = ((udesc.offset % 10) + 1);
-        int tileY = (udesc.offset / 10 + 1);
-        int totalX = size.x * tileX;
-        int totalY = size.y * tileY;
-        numTiles.x = std::max(numTiles.x, tileX);
-        numTiles.y = std::max(numTiles.y, tileY);
-        totalSize.x = std::max(totalSize.x, totalX);
-        totalSize.y = std::max(totalSize.y, totalY);
-        udimTileDescs.emplace_back(udesc);
+        const int offset = std::get<0>(udimTiles[i]);
+        const vec2i tile(offset % 10, offset / 10);
+        minTile = vec2i(std::min(minTile.x, tile.x),
+                        std::min(minTile.y, tile.y));
+        maxTile = vec2i(std::max(maxTile.x, tile.x),
+                        std::max(maxTile.y, tile.y));
+        cellSize = vec2i(std::max(cellSize.x, tiles[i].size.x),
+                         std::max(cellSize.y, tiles[i].size.y));
     }
-
-    numX = numTiles.x;
-    numY = numTiles.y;
-    size_t dataSize = totalSize.x * totalSize.y * texelSize;
-    auto* data = new uint8_t[sizeof(uint8_t) * dataSize];
-
-    // copy tile to main texture
-    for (const auto& tile : udimTileDescs) {
-        vec2i startTexels;
-        startTexels.x = tile.size.x * (tile.offset % 10);
-        startTexels.y = tile.size.y * (tile.offset / 10);
-        size_t dataIndex = startTexels.y * totalSize.x + startTexels.x;
-        size_t tileIndex = 0;
-        for (int y = 0; y < tile.size.y; y++) {
-            size_t start = tileIndex * texelSize;
-            size_t end = (tileIndex + tile.size.x) * texelSize;
-            if (complement && (udimDataType == OSP_FLOAT)) {
-                float* tex = (float*)(tile.data + start);
-                for (int i = 0; i < tile.size.x; i++)
-                    tex[i] = 1.f - tex[i];
+    const vec2i numTiles = maxTile - minTile + vec2i(1);
+    const vec2i totalSize = cellSize * numTiles;
+    const size_t texelSize = tiles[0].texelSize;
+    const OSPDataType dataType = tiles[0].dataType;
+    const OSPTextureFormat format = tiles[0].format;
+
+    // texels of unused tiles stay black
+    const size_t dataSize = size_t(totalSize.x) * totalSize.y * texelSize;
+    auto* data = new uint8_t[dataSize]();
+
+    // copy tiles to the atlas, tiles cover disjoint cells
+    WorkParallelForN(tiles.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            const _UDIMTile& tile = tiles[i];
+            const int offset = std::get<0>(udimTiles[i]);
+            const size_t startX = size_t(offset % 10 - minTile.x) * cellSize.x;
+            const size_t startY = size_t(offset / 10 - minTile.y) * cellSize.y;
+            const size_t rowBytes = tile.size.x * texelSize;
+            // texels of smaller tiles are repeated, which works for all
+            // texel types
+            for (int y = 0; y < cellSize.y; y++) {
+                const size_t srcY = size_t(y) * tile.size.y / cellSize.y;
+                const uint8_t* src = tile.data.get() + srcY * rowBytes;
+                uint8_t* dst = data
+                       + ((startY + y) * totalSize.x + startX) * texelSize;
+                if (tile.size.x == cellSize.x) {
+                    std::copy(src, src + rowBytes, dst);
+                } else {
+                    for (int x = 0; x < cellSize.x; x++) {
+                        const uint8_t* texel = src
+                               + size_t(x) * tile.size.x / cellSize.x
+                                      * texelSize;
+                        std::copy(texel, texel + texelSize,
+                                  dst + x * texelSize);
+                    }
+                }
+                if (complement && (dataType == OSP_FLOAT)) {
+                    float* tex = (float*)dst;
+                    for (int x = 0; x < cellSize.x; x++)
+                        tex[x] = 1.f - tex[x];
+                }
             }
-            std::copy(tile.data + start, tile.data + end,
-                      data + dataIndex * texelSize);
-            tileIndex += tile.size.x;
-            dataIndex += totalSize.x;
         }
-    }
+    });
+    tiles.clear();
 
     // create ospray texture object from data
-    opp::SharedData ospData = opp::SharedData(data, udimDataType, totalSize);
+    opp::SharedData ospData = opp::SharedData(data, dataType, totalSize);
     ospData.commit();
 
     opp::Texture ospTexture = opp::Texture("texture2d");
@@ -474,5 +572,16 @@ LoadUDIMTexture2D(std::string file, int& numX, int& numY, bool nearestFilter,
     auto dataPtr
            = std::shared_ptr<uint8_t>(data, std::default_delete<uint8_t[]>());
 
-    return HdOSPRayTexture(std::move(ospTexture), std::move(dataPtr));
+    HdOSPRayTexture result(std::move(ospTexture), std::move(dataPtr));
+    result.bytes = dataSize;
+    // map texture coordinates of the tile range to the atlas.  OSPRay
+    // scales around the center (0.5, 0.5), translate the scaled texture
+    // from (0.5, 0.5) to (0,0) and the first tile in use to the origin.
+    result.hasXfm = true;
+    result.xfm_scale = { 1.f / float(numTiles.x), 1.f / float(numTiles.y) };
+    result.xfm_translation = { -(.5f - .5f / float(numTiles.x))
+                                       - float(minTile.x) / float(numTiles.x),
+                               -(.5f - .5f / float(numTiles.y))
+                                       - float(minTile.y) / float(numTiles.y) };
+    return result;
 }
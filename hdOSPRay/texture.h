@@ -42,6 +42,7 @@ public:
     bool isPtex { false };
     std::shared_ptr<uint8_t> data; // should be uint8_t[], but to support older
                                    // compilers use custom delete
+    size_t bytes { 0 }; // size of data
 };
 
 OSPTextureFormat osprayTextureFormat(int depth, int channels,
@@ -49,7 +50,7 @@ OSPTextureFormat osprayTextureFormat(int depth, int channels,
 
 opp::Texture LoadPtexTexture(std::string file);
 
-/// @brief  Load pxr Hio Texture
+/// @brief  Load pxr Hio Texture.  Not cached, see HdOSPRayTextureCache.
 /// @param filename
 /// @param nearestFilter or interpolation
 /// @param compute 1.f-val.  float only.
@@ -59,13 +60,14 @@ HdOSPRayTexture LoadHioTexture2D(const std::string file,
                                  bool nearestFilter = false,
                                  bool complement = false);
 
-/// @brief
-/// @param filename
-/// @param number of udim tile columns
-/// @param number of udim tile rows
+/// @brief  Load the tiles of a UDIM texture in parallel into an atlas
+///         covering the range of tiles in use.  The texture transform maps
+///         UDIM texture coordinates to the atlas.  Not cached, see
+///         HdOSPRayTextureCache.
+/// @param filename of the form ...<UDIM>...
 /// @param use nearestFilter or interpolation
 /// @param compute 1.f-val.  float only.
-/// @return OSPRay texture object, data pointer
-HdOSPRayTexture LoadUDIMTexture2D(std::string file, int& numX, int& numY,
+/// @return OSPRay texture object, data pointer, texture transform
+HdOSPRayTexture LoadUDIMTexture2D(std::string file,
                                   bool nearestFilter = false,
                                   bool complement = false);
\ No newline at end of file
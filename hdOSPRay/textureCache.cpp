@@ -0,0 +1,157 @@
+// Copyright 2019 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include "textureCache.h"
+#include "config.h"
+
+#include <pxr/base/tf/instantiateSingleton.h>
+#include <pxr/base/tf/stringUtils.h>
+#include <pxr/base/work/withScopedParallelism.h>
+
+TF_INSTANTIATE_SINGLETON(HdOSPRayTextureCache);
+
+HdOSPRayTextureCache::HdOSPRayTextureCache()
+    : _budget(size_t(HdOSPRayConfig::GetInstance().textureCacheMB) << 20)
+{
+}
+
+/*static*/
+HdOSPRayTextureCache&
+HdOSPRayTextureCache::GetInstance()
+{
+    return TfSingleton<HdOSPRayTextureCache>::GetInstance();
+}
+
+HdOSPRayTexture
+HdOSPRayTextureCache::GetTexture(std::string const& key,
+                                 std::function<HdOSPRayTexture()> const& load)
+{
+    std::promise<HdOSPRayTexture> promise;
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        auto it = _entries.find(key);
+        if (it != _entries.end()) {
+            _lru.splice(_lru.begin(), _lru, it->second.lru);
+            _stats.hits++;
+            return it->second.texture;
+        }
+        auto loading = _loading.find(key);
+        if (loading != _loading.end()) {
+            std::shared_future<HdOSPRayTexture> future = loading->second;
+            _stats.waits++;
+            lock.unlock();
+            return future.get();
+        }
+        _loading.emplace(key, promise.get_future().share());
+        _stats.misses++;
+    }
+
+    // decoded without holding the lock, other textures can be looked up
+    // and loaded concurrently.  Loaders may run parallel loops, which are
+    // isolated so the thread owning this load does not pick up a task
+    // waiting for it.
+    HdOSPRayTexture texture;
+    try {
+        WorkWithScopedParallelism([&]() { texture = load(); });
+    } catch (...) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _loading.erase(key);
+        }
+        promise.set_exception(std::current_exception());
+        throw;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _loading.erase(key);
+        if (texture.ospTexture && texture.data) {
+            _Entry& entry = _entries[key];
+            entry.texture = texture;
+            _lru.push_front(key);
+            entry.lru = _lru.begin();
+            _stats.entries++;
+            _stats.bytes += texture.bytes;
+            // the new texture is referenced by the caller and is not evicted
+            _Evict();
+        }
+    }
+    promise.set_value(texture);
+    return texture;
+}
+
+HdOSPRayTexture
+HdOSPRayTextureCache::GetHioTexture2D(std::string const& file,
+                                      std::string const& channels,
+                                      bool nearestFilter, bool complement)
+{
+    const std::string key = TfStringPrintf("%s:%s:%d:%d", file.c_str(),
+                                           channels.c_str(), nearestFilter,
+                                           complement);
+    return GetTexture(key, [&]() {
+        return LoadHioTexture2D(file, channels, nearestFilter, complement);
+    });
+}
+
+HdOSPRayTexture
+HdOSPRayTextureCache::GetUDIMTexture2D(std::string const& file,
+                                       bool nearestFilter, bool complement)
+{
+    const std::string key = TfStringPrintf("%s:udim:%d:%d", file.c_str(),
+                                           nearestFilter, complement);
+    return GetTexture(key, [&]() {
+        return LoadUDIMTexture2D(file, nearestFilter, complement);
+    });
+}
+
+void
+HdOSPRayTextureCache::Trim()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _Evict();
+}
+
+void
+HdOSPRayTextureCache::Clear()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stats.evictions += _entries.size();
+    _entries.clear();
+    _lru.clear();
+    _stats.entries = 0;
+    _stats.bytes = 0;
+}
+
+HdOSPRayTextureCache::Stats
+HdOSPRayTextureCache::GetStats()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _stats;
+}
+
+void
+HdOSPRayTextureCache::_Evict()
+{
+    if (_stats.bytes <= _budget)
+        return;
+
+    const size_t evictions = _stats.evictions;
+    for (auto it = _lru.end(); it != _lru.begin() && _stats.bytes > _budget;) {
+        --it;
+        auto entry = _entries.find(*it);
+        // only the cache holds the data of unreferenced textures
+        if (entry->second.texture.data.use_count() > 1)
+            continue;
+        _stats.bytes -= entry->second.texture.bytes;
+        _stats.entries--;
+        _stats.evictions++;
+        _entries.erase(entry);
+        it = _lru.erase(it);
+    }
+    TF_DEBUG_MSG(OSP,
+                 "hdosp::textureCache: %zu evicted, %zu textures, %zu MB, "
+                 "%zu hits, %zu misses, %zu waits\n",
+                 _stats.evictions - evictions, _stats.entries,
+                 _stats.bytes >> 20, _stats.hits, _stats.misses,
+                 _stats.waits);
+}
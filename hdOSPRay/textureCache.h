@@ -0,0 +1,104 @@
+// Copyright 2019 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <pxr/base/tf/singleton.h>
+#include <pxr/pxr.h>
+
+#include "texture.h"
+
+#include <functional>
+#include <future>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+/// \class HdOSPRayTextureCache
+///
+/// Decoded textures shared by all materials and lights loading the same file
+/// with the same parameters.  A texture is referenced as long as a copy of
+/// it, which shares its data, is held outside of the cache.  Once the cached
+/// textures exceed the budget of HDOSPRAY_TEXTURE_CACHE_MB, unreferenced
+/// textures are evicted, least recently used first.  Referenced textures are
+/// never evicted, evicting them would not release their memory.
+///
+/// Loading is single-flight: the first requester of a key decodes the
+/// texture, concurrent requesters of the same key wait for its result
+/// instead of decoding the file again.
+///
+/// thread safe.
+///
+class HdOSPRayTextureCache {
+public:
+    struct Stats {
+        size_t hits { 0 };
+        size_t misses { 0 };
+        // requests that waited for a concurrent load of the same key
+        size_t waits { 0 };
+        size_t evictions { 0 };
+        size_t entries { 0 };
+        size_t bytes { 0 };
+    };
+
+    static HdOSPRayTextureCache& GetInstance();
+
+    /// Texture cached under key, calling load to decode it on a miss.
+    /// Blocks while another thread loads the same key.  Textures that
+    /// failed to load are not cached, but handed to the waiting requesters.
+    HdOSPRayTexture GetTexture(std::string const& key,
+                               std::function<HdOSPRayTexture()> const& load);
+
+    /// LoadHioTexture2D through the cache
+    HdOSPRayTexture GetHioTexture2D(std::string const& file,
+                                    std::string const& channels = "",
+                                    bool nearestFilter = false,
+                                    bool complement = false);
+
+    /// LoadUDIMTexture2D through the cache
+    HdOSPRayTexture GetUDIMTexture2D(std::string const& file,
+                                     bool nearestFilter = false,
+                                     bool complement = false);
+
+    /// Evict unreferenced textures until the cache is within budget, e.g.
+    /// after materials released their textures.
+    void Trim();
+
+    /// Drop all cached textures.  Textures still referenced are released
+    /// with their last reference.  Called before OSPRay is shut down.
+    void Clear();
+
+    Stats GetStats();
+
+private:
+    HdOSPRayTextureCache();
+    ~HdOSPRayTextureCache() = default;
+
+    /// _mutex must be held
+    void _Evict();
+
+    struct _Entry {
+        HdOSPRayTexture texture;
+        // position in _lru
+        std::list<std::string>::iterator lru;
+    };
+
+    std::mutex _mutex;
+    std::unordered_map<std::string, _Entry> _entries;
+    // keys of _entries, most recently used first
+    std::list<std::string> _lru;
+    // loads in flight, removed once the texture is cached
+    std::unordered_map<std::string, std::shared_future<HdOSPRayTexture>>
+           _loading;
+    size_t _budget { 0 };
+    Stats _stats;
+
+    friend class TfSingleton<HdOSPRayTextureCache>;
+
+    // This class does not support copying.
+    HdOSPRayTextureCache(const HdOSPRayTextureCache&) = delete;
+    HdOSPRayTextureCache& operator=(const HdOSPRayTextureCache&) = delete;
+};
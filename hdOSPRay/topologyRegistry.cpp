@@ -0,0 +1,193 @@
+// Copyright 2019 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include "topologyRegistry.h"
+
+#include <pxr/imaging/hd/meshUtil.h>
+#include <pxr/imaging/hd/tokens.h>
+
+HdOSPRayTopologyEntry::HdOSPRayTopologyEntry(HdMeshTopology const& topology)
+    : _topology(topology)
+{
+    size_t numFaces = 0;
+    size_t numQuadFaces = 0;
+    for (const int count : _topology.GetFaceVertexCounts()) {
+        if (count < 3)
+            continue;
+        numFaces++;
+        if (count == 4)
+            numQuadFaces++;
+    }
+    if (numFaces)
+        _quadFaceRatio = float(numQuadFaces) / float(numFaces);
+}
+
+void
+HdOSPRayTopologyEntry::_ComputeTriangles() const
+{
+    std::call_once(_trianglesOnce, [this]() {
+        // HdMeshUtil only reads the topology; the id is used for warnings.
+        HdMeshUtil meshUtil(&_topology, SdfPath::EmptyPath());
+        meshUtil.ComputeTriangleIndices(&_triangleIndices,
+                                        &_trianglePrimitiveParams);
+    });
+}
+
+void
+HdOSPRayTopologyEntry::_ComputeQuads() const
+{
+    std::call_once(_quadsOnce, [this]() {
+        // HdMeshUtil::ComputeQuadIndices adds edge and face center vertices
+        // for non-quad faces, which would require refining every vertex
+        // primvar.  Fan-split the faces over their existing corners instead.
+        const VtIntArray& faceVertexCounts = _topology.GetFaceVertexCounts();
+        const VtIntArray& faceVertexIndices = _topology.GetFaceVertexIndices();
+        const int numFaces = faceVertexCounts.size();
+        const int numIndices = faceVertexIndices.size();
+        const bool flip = _topology.GetOrientation() != HdTokens->rightHanded;
+
+        std::vector<bool> holes(numFaces, false);
+        for (const int hole : _topology.GetHoleIndices()) {
+            if (hole >= 0 && hole < numFaces)
+                holes[hole] = true;
+        }
+
+        size_t numQuads = 0;
+        for (const int count : faceVertexCounts) {
+            if (count >= 3)
+                numQuads += (count - 1) / 2;
+        }
+#if HD_API_VERSION < 44
+        _quadIndices.reserve(numQuads);
+#else
+        _quadIndices.reserve(numQuads * 4);
+#endif
+        _quadPrimitiveParams.reserve(numQuads);
+        _quadFaceVaryingIndices.reserve(numQuads * 4);
+
+        std::vector<int> corners;
+        int faceStart = 0;
+        for (int face = 0; face < numFaces;
+             faceStart += faceVertexCounts[face], face++) {
+            const int count = faceVertexCounts[face];
+            if (holes[face] || count < 3 || faceStart + count > numIndices)
+                continue;
+
+            corners.resize(count);
+            corners[0] = faceStart;
+            for (int k = 1; k < count; k++)
+                corners[k] = faceStart + (flip ? count - k : k);
+
+            const int coarseFaceParam
+                   = HdMeshUtil::EncodeCoarseFaceParam(face, 0);
+            for (int k = 1; k + 1 < count; k += 2) {
+                const int quad[4] = { corners[0], corners[k], corners[k + 1],
+                                      corners[k + 2 < count ? k + 2 : k + 1] };
+#if HD_API_VERSION < 44
+                _quadIndices.push_back(GfVec4i(faceVertexIndices[quad[0]],
+                                               faceVertexIndices[quad[1]],
+                                               faceVertexIndices[quad[2]],
+                                               faceVertexIndices[quad[3]]));
+#else
+                for (const int corner : quad)
+                    _quadIndices.push_back(faceVertexIndices[corner]);
+#endif
+                for (const int corner : quad)
+                    _quadFaceVaryingIndices.push_back(corner);
+#if HD_API_VERSION < 36
+                _quadPrimitiveParams.push_back(GfVec2i(coarseFaceParam, 0));
+#else
+                _quadPrimitiveParams.push_back(coarseFaceParam);
+#endif
+            }
+        }
+    });
+}
+
+VtVec3iArray const&
+HdOSPRayTopologyEntry::GetTriangleIndices() const
+{
+    _ComputeTriangles();
+    return _triangleIndices;
+}
+
+VtIntArray const&
+HdOSPRayTopologyEntry::GetTrianglePrimitiveParams() const
+{
+    _ComputeTriangles();
+    return _trianglePrimitiveParams;
+}
+
+HdOSPRayQuadIndexArray const&
+HdOSPRayTopologyEntry::GetQuadIndices() const
+{
+    _ComputeQuads();
+    return _quadIndices;
+}
+
+HdOSPRayQuadPrimitiveParamArray const&
+HdOSPRayTopologyEntry::GetQuadPrimitiveParams() const
+{
+    _ComputeQuads();
+    return _quadPrimitiveParams;
+}
+
+VtIntArray const&
+HdOSPRayTopologyEntry::GetQuadFaceVaryingIndices() const
+{
+    _ComputeQuads();
+    return _quadFaceVaryingIndices;
+}
+
+Hd_VertexAdjacency const&
+HdOSPRayTopologyEntry::GetAdjacency() const
+{
+    std::call_once(_adjacencyOnce,
+                   [this]() { _adjacency.BuildAdjacencyTable(&_topology); });
+    return _adjacency;
+}
+
+HdOSPRayTopologyEntrySharedPtr
+HdOSPRayTopologyRegistry::GetEntry(HdMeshTopology const& topology)
+{
+    const HdTopology::ID hash = topology.ComputeHash();
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto& slot = _entries[hash];
+    HdOSPRayTopologyEntrySharedPtr entry = slot.lock();
+    if (entry) {
+        if (entry->GetTopology() == topology)
+            return entry;
+        // hash collision with a live entry: keep the registered one and
+        // hand out a private entry instead.
+        return std::make_shared<const HdOSPRayTopologyEntry>(topology);
+    }
+
+    entry = std::make_shared<const HdOSPRayTopologyEntry>(topology);
+    slot = entry;
+    return entry;
+}
+
+void
+HdOSPRayTopologyRegistry::GarbageCollect()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto it = _entries.begin(); it != _entries.end();) {
+        if (it->second.expired())
+            it = _entries.erase(it);
+        else
+            ++it;
+    }
+}
+
+size_t
+HdOSPRayTopologyRegistry::GetNumEntries()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    size_t numEntries = 0;
+    for (const auto& it : _entries) {
+        if (!it.second.expired())
+            numEntries++;
+    }
+    return numEntries;
+}
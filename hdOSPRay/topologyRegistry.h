@@ -0,0 +1,128 @@
+// Copyright 2019 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <pxr/base/vt/array.h>
+#include <pxr/base/vt/types.h>
+#include <pxr/imaging/hd/meshTopology.h>
+#include <pxr/imaging/hd/vertexAdjacency.h>
+#include <pxr/imaging/hd/version.h>
+#include <pxr/pxr.h>
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+#if HD_API_VERSION < 44
+typedef VtVec4iArray HdOSPRayQuadIndexArray;
+#else
+typedef VtIntArray HdOSPRayQuadIndexArray;
+#endif
+#if HD_API_VERSION < 36
+typedef VtVec2iArray HdOSPRayQuadPrimitiveParamArray;
+#else
+typedef VtIntArray HdOSPRayQuadPrimitiveParamArray;
+#endif
+
+/// \class HdOSPRayTopologyEntry
+///
+/// Connectivity derived from a single HdMeshTopology: triangulated and
+/// quadrangulated indices, their primitive params and the vertex adjacency
+/// table.  Each buffer is computed on first request and is read-only
+/// afterwards, so it can be handed to OSPRay as SharedData by every mesh
+/// holding the entry.
+///
+/// Quads are built without adding vertices: quad faces are kept, triangles
+/// become degenerate quads (last two indices equal) and larger faces are
+/// fan-split into quads, so points and vertex primvars are used unchanged.
+///
+class HdOSPRayTopologyEntry {
+public:
+    HdOSPRayTopologyEntry(HdMeshTopology const& topology);
+    ~HdOSPRayTopologyEntry() = default;
+
+    HdMeshTopology const& GetTopology() const
+    {
+        return _topology;
+    }
+
+    VtVec3iArray const& GetTriangleIndices() const;
+    VtIntArray const& GetTrianglePrimitiveParams() const;
+
+    HdOSPRayQuadIndexArray const& GetQuadIndices() const;
+    HdOSPRayQuadPrimitiveParamArray const& GetQuadPrimitiveParams() const;
+    /// Face-varying value index of each quad corner, 4 per quad
+    VtIntArray const& GetQuadFaceVaryingIndices() const;
+
+    /// Fraction of valid faces that are quads
+    float GetQuadFaceRatio() const
+    {
+        return _quadFaceRatio;
+    }
+
+    Hd_VertexAdjacency const& GetAdjacency() const;
+
+private:
+    void _ComputeTriangles() const;
+    void _ComputeQuads() const;
+
+    const HdMeshTopology _topology;
+
+    mutable std::once_flag _trianglesOnce;
+    mutable VtVec3iArray _triangleIndices;
+    mutable VtIntArray _trianglePrimitiveParams;
+
+    mutable std::once_flag _quadsOnce;
+    mutable HdOSPRayQuadIndexArray _quadIndices;
+    mutable HdOSPRayQuadPrimitiveParamArray _quadPrimitiveParams;
+    mutable VtIntArray _quadFaceVaryingIndices;
+    float _quadFaceRatio { 0.f };
+
+    mutable std::once_flag _adjacencyOnce;
+    mutable Hd_VertexAdjacency _adjacency;
+
+    // This class does not support copying.
+    HdOSPRayTopologyEntry(const HdOSPRayTopologyEntry&) = delete;
+    HdOSPRayTopologyEntry& operator=(const HdOSPRayTopologyEntry&) = delete;
+};
+
+typedef std::shared_ptr<const HdOSPRayTopologyEntry>
+       HdOSPRayTopologyEntrySharedPtr;
+
+/// \class HdOSPRayTopologyRegistry
+///
+/// Shares HdOSPRayTopologyEntry objects between meshes with identical
+/// connectivity, e.g. crowd variants or per-frame copies of the same asset.
+/// Entries are looked up by HdMeshTopology hash and are only held weakly, so
+/// they are released together with the last mesh referencing them.
+///
+/// thread safe.
+///
+class HdOSPRayTopologyRegistry {
+public:
+    HdOSPRayTopologyRegistry() = default;
+    ~HdOSPRayTopologyRegistry() = default;
+
+    /// Return the shared entry for topology, creating it if needed.
+    HdOSPRayTopologyEntrySharedPtr GetEntry(HdMeshTopology const& topology);
+
+    /// Drop map slots of entries no longer referenced by any mesh.
+    void GarbageCollect();
+
+    /// Number of live entries.
+    size_t GetNumEntries();
+
+private:
+    std::mutex _mutex;
+    std::unordered_map<HdTopology::ID,
+                       std::weak_ptr<const HdOSPRayTopologyEntry>>
+           _entries;
+
+    // This class does not support copying.
+    HdOSPRayTopologyRegistry(const HdOSPRayTopologyRegistry&) = delete;
+    HdOSPRayTopologyRegistry& operator=(const HdOSPRayTopologyRegistry&)
+           = delete;
+};